@@ -324,6 +324,30 @@ do {									\
 #define irqsafe_cpu_or_8(pcp, val)	percpu_to_op("or", (pcp), val)
 #define irqsafe_cpu_xor_8(pcp, val)	percpu_to_op("xor", (pcp), val)
 
+/*
+ * Compare and exchange two adjacent per cpu words with cmpxchg16b.  The
+ * words must be 16 byte aligned.  The instruction is missing on some early
+ * AMD64 processors, those fall back to the generic version that disables
+ * interrupts.
+ */
+#define irqsafe_cpu_cmpxchg_double(pcp1, pcp2, o1, o2, n1, n2)		\
+({									\
+	char __ret;							\
+	typeof(pcp1) __o1 = (o1), __n1 = (n1);				\
+	typeof(pcp2) __o2 = (o2), __n2 = (n2);				\
+									\
+	BUILD_BUG_ON(sizeof(pcp1) != 8 || sizeof(pcp2) != 8);		\
+	if (static_cpu_has(X86_FEATURE_CX16))				\
+		asm volatile("cmpxchg16b "__percpu_arg(1)"\n\tsetz %0"	\
+			     : "=q" (__ret), "+m" (pcp1), "+m" (pcp2),	\
+			       "+a" (__o1), "+d" (__o2)			\
+			     : "b" (__n1), "c" (__n2));			\
+	else								\
+		__ret = irqsafe_generic_cpu_cmpxchg_double((pcp1), (pcp2), \
+					__o1, __o2, __n1, __n2);	\
+	__ret;								\
+})
+
 #endif
 
 /* This is not atomic against other CPUs -- CPU preemption needs to be off */
@@ -194,17 +194,21 @@ static void native_stop_other_cpus(int wait)
 }
 
 /*
- * Reschedule call back. Nothing to do,
- * all the work is done automatically when
- * we return from the interrupt.
+ * Reschedule call back.  Queued wakeups are handed to the scheduler,
+ * the reschedule itself happens when we return from the interrupt.
  */
 void smp_reschedule_interrupt(struct pt_regs *regs)
 {
+	struct pt_regs *old_regs = set_irq_regs(regs);
+
 	ack_APIC_irq();
 	inc_irq_stat(irq_resched_count);
+	/* nohz_full cpus look at regs to tell a user mode quiescent state */
+	scheduler_ipi();
 	/*
 	 * KVM uses this interrupt to force a cpu out of guest mode
 	 */
+	set_irq_regs(old_regs);
 }
 
 void smp_call_function_interrupt(struct pt_regs *regs)
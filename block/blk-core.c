@@ -27,6 +27,7 @@
 #include <linux/writeback.h>
 #include <linux/task_io_accounting_ops.h>
 #include <linux/fault-inject.h>
+#include <linux/list_sort.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
@@ -1182,15 +1183,119 @@ static inline bool queue_should_plug(struct request_queue *q)
 	return !(blk_queue_nonrot(q) && blk_queue_tagged(q));
 }
 
+static bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
+				   struct bio *bio)
+{
+	const int ff = bio->bi_rw & REQ_FAILFAST_MASK;
+
+	if (!ll_back_merge_fn(q, req, bio))
+		return false;
+
+	trace_block_bio_backmerge(q, bio);
+
+	if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff)
+		blk_rq_set_mixed_merge(req);
+
+	req->biotail->bi_next = bio;
+	req->biotail = bio;
+	req->__data_len += bio->bi_size;
+	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	if (!blk_rq_cpu_valid(req))
+		req->cpu = bio->bi_comp_cpu;
+	drive_stat_acct(req, 0);
+	return true;
+}
+
+static bool bio_attempt_front_merge(struct request_queue *q,
+				    struct request *req, struct bio *bio)
+{
+	const int ff = bio->bi_rw & REQ_FAILFAST_MASK;
+
+	if (!ll_front_merge_fn(q, req, bio))
+		return false;
+
+	trace_block_bio_frontmerge(q, bio);
+
+	if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff) {
+		blk_rq_set_mixed_merge(req);
+		req->cmd_flags &= ~REQ_FAILFAST_MASK;
+		req->cmd_flags |= ff;
+	}
+
+	bio->bi_next = req->bio;
+	req->bio = bio;
+
+	/*
+	 * may not be valid. if the low level driver said
+	 * it didn't need a bounce buffer then it better
+	 * not touch req->buffer either...
+	 */
+	req->buffer = bio_data(bio);
+	req->__sector = bio->bi_sector;
+	req->__data_len += bio->bi_size;
+	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	if (!blk_rq_cpu_valid(req))
+		req->cpu = bio->bi_comp_cpu;
+	drive_stat_acct(req, 0);
+	return true;
+}
+
+/*
+ * Try to merge @bio into a request sitting on the current task's plug
+ * list.  Those requests are private to the task, so no lock is needed.
+ */
+static bool attempt_plug_merge(struct task_struct *tsk, struct request_queue *q,
+			       struct bio *bio)
+{
+	struct blk_plug *plug = tsk->plug;
+	struct request *rq;
+
+	if (!plug || blk_queue_nomerges(q))
+		return false;
+
+	list_for_each_entry_reverse(rq, &plug->list, queuelist) {
+		if (rq->q != q || !rq_mergeable(rq) ||
+		    !elv_rq_merge_ok(rq, bio))
+			continue;
+
+		if (blk_rq_pos(rq) + blk_rq_sectors(rq) == bio->bi_sector) {
+			if (bio_attempt_back_merge(q, rq, bio))
+				return true;
+		} else if (blk_rq_pos(rq) - bio_sectors(bio) == bio->bi_sector) {
+			if (bio_attempt_front_merge(q, rq, bio))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void add_plug_request(struct blk_plug *plug, struct request *req)
+{
+	struct request_queue *q = req->q;
+
+	/*
+	 * Note the first request of a plug for blktrace, and remember to
+	 * sort the list if it spans queues or goes backwards on disk.
+	 */
+	if (list_empty(&plug->list))
+		trace_block_plug(q);
+	else if (!plug->should_sort) {
+		struct request *last = list_entry_rq(plug->list.prev);
+
+		if (last->q != q || blk_rq_pos(last) > blk_rq_pos(req))
+			plug->should_sort = 1;
+	}
+	list_add_tail(&req->queuelist, &plug->list);
+}
+
 static int __make_request(struct request_queue *q, struct bio *bio)
 {
 	struct request *req;
+	struct blk_plug *plug;
 	int el_ret;
-	unsigned int bytes = bio->bi_size;
-	const unsigned short prio = bio_prio(bio);
 	const bool sync = !!(bio->bi_rw & REQ_SYNC);
 	const bool unplug = !!(bio->bi_rw & REQ_UNPLUG);
-	const unsigned long ff = bio->bi_rw & REQ_FAILFAST_MASK;
 	int where = ELEVATOR_INSERT_SORT;
 	int rw_flags;
 
@@ -1208,78 +1313,49 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	 */
 	blk_queue_bounce(q, &bio);
 
-	spin_lock_irq(q->queue_lock);
-
+	plug = current->plug;
 	if (bio->bi_rw & (REQ_FLUSH | REQ_FUA)) {
+		/*
+		 * Flushes bypass the plug, so send what the task has
+		 * plugged so far ahead of them to keep the ordering.
+		 */
+		if (plug)
+			blk_flush_plug_list(plug);
+		plug = NULL;
+		spin_lock_irq(q->queue_lock);
 		where = ELEVATOR_INSERT_FRONT;
 		goto get_rq;
 	}
 
+	/*
+	 * Check if we can merge with the plugged list before grabbing
+	 * any locks.
+	 */
+	if (attempt_plug_merge(current, q, bio))
+		return 0;
+
+	spin_lock_irq(q->queue_lock);
+
 	if (elv_queue_empty(q))
 		goto get_rq;
 
 	el_ret = elv_merge(q, &req, bio);
-	switch (el_ret) {
-	case ELEVATOR_BACK_MERGE:
+	if (el_ret == ELEVATOR_BACK_MERGE) {
 		BUG_ON(!rq_mergeable(req));
-
-		if (!ll_back_merge_fn(q, req, bio))
-			break;
-
-		trace_block_bio_backmerge(q, bio);
-
-		if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff)
-			blk_rq_set_mixed_merge(req);
-
-		req->biotail->bi_next = bio;
-		req->biotail = bio;
-		req->__data_len += bytes;
-		req->ioprio = ioprio_best(req->ioprio, prio);
-		if (!blk_rq_cpu_valid(req))
-			req->cpu = bio->bi_comp_cpu;
-		drive_stat_acct(req, 0);
-		elv_bio_merged(q, req, bio);
-		if (!attempt_back_merge(q, req))
-			elv_merged_request(q, req, el_ret);
-		goto out;
-
-	case ELEVATOR_FRONT_MERGE:
+		if (bio_attempt_back_merge(q, req, bio)) {
+			elv_bio_merged(q, req, bio);
+			if (!attempt_back_merge(q, req))
+				elv_merged_request(q, req, el_ret);
+			goto out;
+		}
+	} else if (el_ret == ELEVATOR_FRONT_MERGE) {
 		BUG_ON(!rq_mergeable(req));
-
-		if (!ll_front_merge_fn(q, req, bio))
-			break;
-
-		trace_block_bio_frontmerge(q, bio);
-
-		if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff) {
-			blk_rq_set_mixed_merge(req);
-			req->cmd_flags &= ~REQ_FAILFAST_MASK;
-			req->cmd_flags |= ff;
+		if (bio_attempt_front_merge(q, req, bio)) {
+			elv_bio_merged(q, req, bio);
+			if (!attempt_front_merge(q, req))
+				elv_merged_request(q, req, el_ret);
+			goto out;
 		}
-
-		bio->bi_next = req->bio;
-		req->bio = bio;
-
-		/*
-		 * may not be valid. if the low level driver said
-		 * it didn't need a bounce buffer then it better
-		 * not touch req->buffer either...
-		 */
-		req->buffer = bio_data(bio);
-		req->__sector = bio->bi_sector;
-		req->__data_len += bytes;
-		req->ioprio = ioprio_best(req->ioprio, prio);
-		if (!blk_rq_cpu_valid(req))
-			req->cpu = bio->bi_comp_cpu;
-		drive_stat_acct(req, 0);
-		elv_bio_merged(q, req, bio);
-		if (!attempt_front_merge(q, req))
-			elv_merged_request(q, req, el_ret);
-		goto out;
-
-	/* ELV_NO_MERGE: elevator says don't/can't merge. */
-	default:
-		;
 	}
 
 get_rq:
@@ -1306,6 +1382,18 @@ get_rq:
 	 */
 	init_request_from_bio(req, bio);
 
+	if (plug) {
+		/*
+		 * The request stays on the task's plug list until
+		 * blk_flush_plug_list() hands it to the elevator.
+		 */
+		if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
+		    bio_flagged(bio, BIO_CPU_AFFINE))
+			req->cpu = blk_cpu_to_group(raw_smp_processor_id());
+		add_plug_request(plug, req);
+		return 0;
+	}
+
 	spin_lock_irq(q->queue_lock);
 	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
 	    bio_flagged(bio, BIO_CPU_AFFINE))
@@ -2601,6 +2689,115 @@ int kblockd_schedule_work(struct request_queue *q, struct work_struct *work)
 }
 EXPORT_SYMBOL(kblockd_schedule_work);
 
+#define PLUG_MAGIC	0x91827364
+
+/**
+ * blk_start_plug - start batching requests in the current task
+ * @plug:	The &struct blk_plug, usually on the caller's stack
+ *
+ * Description:
+ *   Requests built by __make_request() after this call are kept on @plug
+ *   instead of being inserted into their queue one at a time, so that
+ *   following bios can merge into them without any locking.  They are
+ *   handed to the I/O scheduler by blk_finish_plug(), or earlier if the
+ *   task goes to sleep.  Nested plugs are folded into the outermost one.
+ **/
+void blk_start_plug(struct blk_plug *plug)
+{
+	struct task_struct *tsk = current;
+
+	plug->magic = PLUG_MAGIC;
+	INIT_LIST_HEAD(&plug->list);
+	plug->should_sort = 0;
+
+	/*
+	 * If this is a nested plug, don't actually assign it. It will be
+	 * flushed on its own.
+	 */
+	if (!tsk->plug)
+		tsk->plug = plug;
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+static int plug_rq_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct request *rqa = container_of(a, struct request, queuelist);
+	struct request *rqb = container_of(b, struct request, queuelist);
+
+	if (rqa->q != rqb->q)
+		return rqa->q > rqb->q;
+	return blk_rq_pos(rqa) > blk_rq_pos(rqb);
+}
+
+/**
+ * blk_flush_plug_list - hand plugged requests to their queues
+ * @plug:	The &struct blk_plug to flush
+ *
+ * Description:
+ *   Sorts the plugged requests by queue and sector, then inserts each
+ *   queue's batch under a single hold of its queue_lock, merging
+ *   adjacent requests on the way, and kicks the queue.
+ **/
+void blk_flush_plug_list(struct blk_plug *plug)
+{
+	struct request_queue *q;
+	unsigned long flags;
+	struct request *rq;
+	LIST_HEAD(list);
+
+	BUG_ON(plug->magic != PLUG_MAGIC);
+
+	if (list_empty(&plug->list))
+		return;
+
+	list_splice_init(&plug->list, &list);
+
+	if (plug->should_sort) {
+		list_sort(NULL, &list, plug_rq_cmp);
+		plug->should_sort = 0;
+	}
+
+	q = NULL;
+	local_irq_save(flags);
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		BUG_ON(!rq->q);
+		if (rq->q != q) {
+			if (q) {
+				trace_block_unplug_io(q);
+				__blk_run_queue(q);
+				spin_unlock(q->queue_lock);
+			}
+			q = rq->q;
+			spin_lock(q->queue_lock);
+		}
+		drive_stat_acct(rq, 1);
+		__elv_add_request(q, rq, ELEVATOR_INSERT_SORT_MERGE, 0);
+	}
+
+	if (q) {
+		trace_block_unplug_io(q);
+		__blk_run_queue(q);
+		spin_unlock(q->queue_lock);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(blk_flush_plug_list);
+
+/**
+ * blk_finish_plug - submit the requests batched since blk_start_plug()
+ * @plug:	The &struct blk_plug passed to blk_start_plug()
+ **/
+void blk_finish_plug(struct blk_plug *plug)
+{
+	blk_flush_plug_list(plug);
+
+	if (plug == current->plug)
+		current->plug = NULL;
+}
+EXPORT_SYMBOL(blk_finish_plug);
+
 int kblockd_schedule_delayed_work(struct request_queue *q,
 			struct delayed_work *dwork, unsigned long delay)
 {
@@ -1456,6 +1456,50 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking locks or references
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * Returns: dentry, or NULL
+ *
+ * __d_lookup_rcu is the RCU path walk variant of __d_lookup. The caller
+ * must hold rcu_read_lock() and must validate the result against
+ * rename_lock before relying on it: since neither d_lock nor a reference
+ * is taken, a concurrent d_move() may hand us a stale name or parent.
+ * The dentry stays allocated until the end of the RCU read side section.
+ *
+ * Parents with a ->d_compare operation are not supported; callers must
+ * fall back to __d_lookup for those.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		struct qstr *qstr;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+
+		qstr = &dentry->d_name;
+		if (qstr->len != len)
+			continue;
+		if (memcmp(qstr->name, str, len))
+			continue;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -459,10 +459,26 @@ force_reval_path(struct path *path, struct nameidata *nd)
  * short-cut DAC fails, then call ->permission() to do more
  * complete permission check.
  */
-static int exec_permission(struct inode *inode)
+static int exec_permission(struct inode *inode, unsigned int flags)
 {
 	int ret;
 
+	if (flags & LOOKUP_RCU) {
+		/*
+		 * No reference is held on @inode: stay away from anything
+		 * that may sleep (->permission, ACL lookups, capability
+		 * auditing) and let ref-walk redo such directories.
+		 */
+		if (inode->i_op->permission)
+			return -ECHILD;
+		if (IS_POSIXACL(inode) && inode->i_op->check_acl &&
+		    (inode->i_mode & S_IRWXG) && current_fsuid() != inode->i_uid)
+			return -ECHILD;
+		if (acl_permission_check(inode, MAY_EXEC, NULL))
+			return -ECHILD;
+		return security_inode_exec_permission(inode, 1);
+	}
+
 	if (inode->i_op->permission) {
 		ret = inode->i_op->permission(inode, MAY_EXEC);
 		if (!ret)
@@ -478,7 +494,7 @@ static int exec_permission(struct inode *inode)
 
 	return ret;
 ok:
-	return security_inode_permission(inode, MAY_EXEC);
+	return security_inode_exec_permission(inode, 0);
 }
 
 static __always_inline void set_root(struct nameidata *nd)
@@ -837,7 +853,7 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 		unsigned int c;
 
 		nd->flags |= LOOKUP_CONTINUE;
-		err = exec_permission(inode);
+		err = exec_permission(inode, 0);
  		if (err)
 			break;
 
@@ -977,6 +993,152 @@ return_err:
 	return err;
 }
 
+/*
+ * RCU path walk ("rcu-walk").
+ *
+ * Resolve @name from the dcache without taking dentry references,
+ * d_lock or dcache_lock: components are looked up with __d_lookup_rcu()
+ * under rcu_read_lock() and the whole walk is validated against
+ * rename_lock at the end, where a single reference is taken on the
+ * resulting dentry.
+ *
+ * Only the common case is handled: cached components within one mount
+ * of an FS_RCU_PATH_WALK filesystem, without symlinks, "..", mount
+ * points, trailing slashes or dentry operations.  Anything else returns
+ * -ECHILD with @nd untouched, and the caller redoes the walk with the
+ * reference counted link_path_walk() ("ref-walk").
+ *
+ * Otherwise follows the link_path_walk() conventions: returns 0 with the
+ * reference on nd->path moved to the result, or an error with nd->path
+ * dropped.
+ */
+static int link_path_walk_rcu(const char *name, struct nameidata *nd)
+{
+	struct dentry *dentry = nd->path.dentry;
+	struct inode *inode = dentry->d_inode;
+	unsigned int lookup_flags = nd->flags;
+	struct qstr this;
+	unsigned seq;
+
+	if (!(nd->path.mnt->mnt_sb->s_type->fs_flags & FS_RCU_PATH_WALK))
+		return -ECHILD;
+	if (nd->flags & LOOKUP_REVAL)
+		return -ECHILD;
+
+	while (*name == '/')
+		name++;
+	if (!*name)
+		return -ECHILD;
+
+	rcu_read_lock();
+	seq = read_seqbegin(&rename_lock);
+
+	for (;;) {
+		struct dentry *next;
+		unsigned long hash;
+		unsigned int c;
+
+		if (exec_permission(inode, LOOKUP_RCU))
+			goto unlazy_fail;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		if (c) {
+			while (*++name == '/');
+			if (!*name)
+				goto unlazy_fail;
+		}
+
+		if (this.name[0] == '.') {
+			if (this.len == 2 && this.name[1] == '.')
+				goto unlazy_fail;
+			if (this.len == 1) {
+				if (!c)
+					goto unlazy_fail;
+				continue;
+			}
+		}
+
+		if (!c && (lookup_flags & LOOKUP_PARENT))
+			break;
+
+		if (dentry->d_op &&
+		    (dentry->d_op->d_hash || dentry->d_op->d_compare))
+			goto unlazy_fail;
+		next = __d_lookup_rcu(dentry, &this);
+		if (!next)
+			goto unlazy_fail;
+		if (next->d_op && next->d_op->d_revalidate)
+			goto unlazy_fail;
+		if (d_mountpoint(next))
+			goto unlazy_fail;
+
+		dentry = next;
+		inode = dentry->d_inode;
+		if (!inode) {
+			if (c)
+				goto unlazy_fail;
+			break;
+		}
+		if (c) {
+			if (inode->i_op->follow_link || !inode->i_op->lookup)
+				goto unlazy_fail;
+			continue;
+		}
+		if (follow_on_final(inode, lookup_flags))
+			goto unlazy_fail;
+		if ((lookup_flags & LOOKUP_DIRECTORY) && !inode->i_op->lookup)
+			goto unlazy_fail;
+		break;
+	}
+
+	/*
+	 * Leave RCU mode: the dentry we ended on must still be hashed with
+	 * the inode we checked, and nothing may have been renamed under us.
+	 * nd->path.dentry is the one dentry we already hold a reference on.
+	 */
+	if (dentry != nd->path.dentry) {
+		spin_lock(&dentry->d_lock);
+		if (d_unhashed(dentry) || dentry->d_inode != inode ||
+		    read_seqretry(&rename_lock, seq)) {
+			spin_unlock(&dentry->d_lock);
+			goto unlazy_fail;
+		}
+		atomic_inc(&dentry->d_count);
+		spin_unlock(&dentry->d_lock);
+	} else if (read_seqretry(&rename_lock, seq))
+		goto unlazy_fail;
+	rcu_read_unlock();
+
+	dput(nd->path.dentry);
+	nd->path.dentry = dentry;
+
+	if (!inode) {
+		/* cached negative dentry, just like ref-walk */
+		path_put(&nd->path);
+		return -ENOENT;
+	}
+	if (lookup_flags & LOOKUP_PARENT) {
+		nd->last = this;
+		nd->last_type = LAST_NORM;
+	}
+	return 0;
+
+unlazy_fail:
+	rcu_read_unlock();
+	return -ECHILD;
+}
+
 static int path_walk(const char *name, struct nameidata *nd)
 {
 	struct path save = nd->path;
@@ -984,6 +1146,10 @@ static int path_walk(const char *name, struct nameidata *nd)
 
 	current->total_link_count = 0;
 
+	result = link_path_walk_rcu(name, nd);
+	if (result != -ECHILD)
+		return result;
+
 	/* make sure the stuff we saved doesn't go away */
 	path_get(&save);
 
@@ -1125,7 +1291,7 @@ static struct dentry *__lookup_hash(struct qstr *name,
 	struct dentry *dentry;
 	int err;
 
-	err = exec_permission(inode);
+	err = exec_permission(inode, 0);
 	if (err)
 		return ERR_PTR(err);
 
@@ -1778,7 +1944,9 @@ reval:
 		nd.flags |= LOOKUP_REVAL;
 
 	current->total_link_count = 0;
-	error = link_path_walk(pathname, &nd);
+	error = link_path_walk_rcu(pathname, &nd);
+	if (error == -ECHILD)
+		error = link_path_walk(pathname, &nd);
 	if (error) {
 		filp = ERR_PTR(error);
 		goto out;
@@ -73,6 +73,7 @@ static struct super_block *alloc_super(struct file_system_type *type)
 		INIT_LIST_HEAD(&s->s_instances);
 		INIT_HLIST_HEAD(&s->s_anon);
 		INIT_LIST_HEAD(&s->s_inodes);
+		spin_lock_init(&s->s_inodes_lock);
 		INIT_LIST_HEAD(&s->s_dentry_lru);
 		init_rwsem(&s->s_umount);
 		mutex_init(&s->s_lock);
@@ -176,6 +177,13 @@ void deactivate_locked_super(struct super_block *s)
 	struct file_system_type *fs = s->s_type;
 	if (atomic_dec_and_test(&s->s_active)) {
 		fs->kill_sb(s);
+		/*
+		 * Inodes of FS_RCU_PATH_WALK filesystems are freed from RCU
+		 * callbacks that still use ->s_op; wait for them before the
+		 * superblock (and possibly the module) goes away.
+		 */
+		if (fs->fs_flags & FS_RCU_PATH_WALK)
+			rcu_barrier();
 		put_filesystem(fs);
 		put_super(s);
 	} else {
@@ -273,7 +281,7 @@ void generic_shutdown_super(struct super_block *sb)
 		get_fs_excl();
 		sb->s_flags &= ~MS_ACTIVE;
 
-		fsnotify_unmount_inodes(&sb->s_inodes);
+		fsnotify_unmount_inodes(sb);
 
 		evict_inodes(sb);
 
@@ -26,6 +26,14 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Request exclusive wakeup mode for the target file descriptor: when
+ * several epoll instances wait on the same file, an event wakes only
+ * one of them that has a waiter instead of all of them. Only valid
+ * with EPOLL_CTL_ADD.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
 
@@ -185,6 +185,11 @@ struct inodes_stat_t {
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
 					 */
+#define FS_RCU_PATH_WALK	65536	/* Inodes are freed after an RCU
+					 * grace period, so cached path
+					 * components may be walked without
+					 * taking references.
+					 */
 
 /*
  * These are the fs-independent mount-flags: up to 32 flags are supported
@@ -637,6 +642,8 @@ struct address_space {
 	struct list_head	i_mmap_nonlinear;/*list VM_NONLINEAR mappings */
 	spinlock_t		i_mmap_lock;	/* protect tree, count, list */
 	unsigned int		truncate_count;	/* Cover race condition with truncate */
+	unsigned int		ra_hist_size;	/* size of the last readahead window */
+	pgoff_t			ra_hist_start;	/* and where it started, for new opens */
 	unsigned long		nrpages;	/* number of total pages */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
@@ -733,10 +740,14 @@ struct posix_acl;
 
 struct inode {
 	struct hlist_node	i_hash;
+	struct hlist_head	*i_hash_head;	/* chain i_hash is on, if any */
 	struct list_head	i_wb_list;	/* backing dev IO list */
 	struct list_head	i_lru;		/* inode LRU list */
 	struct list_head	i_sb_list;
-	struct list_head	i_dentry;
+	union {
+		struct list_head	i_dentry;
+		struct rcu_head		i_rcu;
+	};
 	unsigned long		i_ino;
 	atomic_t		i_count;
 	unsigned int		i_nlink;
@@ -755,7 +766,7 @@ struct inode {
 	blkcnt_t		i_blocks;
 	unsigned short          i_bytes;
 	umode_t			i_mode;
-	spinlock_t		i_lock;	/* i_blocks, i_bytes, maybe i_size */
+	spinlock_t		i_lock;	/* i_state, i_blocks, i_bytes, maybe i_size */
 	struct mutex		i_mutex;
 	struct rw_semaphore	i_alloc_sem;
 	const struct inode_operations	*i_op;
@@ -899,6 +910,22 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * Access patterns told apart by ondemand readahead
+ */
+enum readahead_pattern {
+	RA_PATTERN_INITIAL,		/* start of file or of a new stream */
+	RA_PATTERN_SUBSEQUENT,		/* sequential, window pushed forward */
+	RA_PATTERN_CONTEXT,		/* sequential, found from cached pages */
+	RA_PATTERN_MARKER,		/* interleaved, found from PG_readahead */
+	RA_PATTERN_STRIDE,		/* same-sized reads with a fixed gap */
+	RA_PATTERN_BACKWARDS,		/* sequential, towards the file start */
+	RA_PATTERN_OVERSIZE,		/* a read larger than the window */
+	RA_PATTERN_MMAP_AROUND,		/* around an mmap fault */
+	RA_PATTERN_RANDOM,		/* none of the above: read as is */
+	RA_PATTERN_MAX
+};
+
 /*
  * Track a single file's readahead state
  */
@@ -911,6 +938,9 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	unsigned int stride;		/* pages skipped between the last reads */
+	unsigned int pattern;		/* RA_PATTERN_* of the last readahead */
 };
 
 /*
@@ -1370,6 +1400,7 @@ struct super_block {
 #endif
 	const struct xattr_handler **s_xattr;
 
+	spinlock_t		s_inodes_lock;	/* protects s_inodes */
 	struct list_head	s_inodes;	/* all inodes */
 	struct hlist_head	s_anon;		/* anonymous dentries for (nfs) exporting */
 #ifdef CONFIG_SMP
@@ -1616,7 +1647,7 @@ struct super_operations {
 };
 
 /*
- * Inode state bits.  Protected by inode_lock.
+ * Inode state bits.  Protected by inode->i_lock.
  *
  * Three bits determine the dirty state of the inode, I_DIRTY_SYNC,
  * I_DIRTY_DATASYNC and I_DIRTY_PAGES.
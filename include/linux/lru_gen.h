@@ -0,0 +1,172 @@
+#ifndef __LINUX_LRU_GEN_H
+#define __LINUX_LRU_GEN_H
+/*
+ * Multi-generational LRU.
+ *
+ * Each page on the LRU lists carries in page->flags the generation in
+ * which it was last seen referenced.  Aging opens a new generation and
+ * walks the page tables of the processes that ran since the previous
+ * walk, moving every page behind a young pte into it; reclaim then
+ * judges a page by how many generations old it is, without walking its
+ * reverse mappings.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+
+struct mm_struct;
+
+#ifdef CONFIG_LRU_GEN
+
+/* a page younger than this many generations is not reclaimed */
+#define LRU_GEN_MIN_NR_GENS	2
+
+/* generation 0 in page->flags means "none", so sequence numbers wrap here */
+#define LRU_GEN_NR_SEQ		((1UL << LRU_GEN_WIDTH) - 1)
+
+/*
+ * Ages saturate here.  Aging pulls older pages back to this age every
+ * LRU_GEN_MAX_AGE passes, so no page gets far enough behind for its
+ * generation number to come round again.
+ */
+#define LRU_GEN_MAX_AGE		(LRU_GEN_NR_SEQ / 2)
+
+extern int lru_gen_mode;
+extern unsigned long lru_gen_max_seq;
+
+static inline int lru_gen_enabled(void)
+{
+	return lru_gen_mode;
+}
+
+static inline unsigned long lru_gen_from_seq(unsigned long seq)
+{
+	return seq % LRU_GEN_NR_SEQ + 1;
+}
+
+static inline unsigned long page_lru_gen(struct page *page)
+{
+	return (page->flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF;
+}
+
+/*
+ * page->flags is updated with atomic bitops elsewhere, so the generation
+ * field has to be replaced with cmpxchg rather than a plain store.
+ */
+static inline void lru_gen_set_seq(struct page *page, unsigned long seq)
+{
+	unsigned long old, new;
+
+	do {
+		old = page->flags;
+		new = (old & ~LRU_GEN_MASK) |
+			(lru_gen_from_seq(seq) << LRU_GEN_PGOFF);
+		if (new == old)
+			return;
+	} while (cmpxchg(&page->flags, old, new) != old);
+}
+
+/* The page was referenced: move it into the youngest generation */
+static inline void lru_gen_touch_page(struct page *page)
+{
+	if (lru_gen_enabled())
+		lru_gen_set_seq(page, ACCESS_ONCE(lru_gen_max_seq));
+}
+
+/*
+ * A page entering the LRU without a generation is placed by how it got
+ * there: active pages are young, new anon pages one generation behind,
+ * and inactive file pages, read once or by readahead, go straight into
+ * the oldest generation, so that streaming IO is reclaimed first.
+ */
+static inline void lru_gen_add_page(struct page *page)
+{
+	unsigned long seq;
+
+	if (!lru_gen_enabled() || page_lru_gen(page))
+		return;
+
+	seq = ACCESS_ONCE(lru_gen_max_seq);
+	if (!PageActive(page)) {
+		if (PageSwapBacked(page))
+			seq -= 1;
+		else
+			seq -= LRU_GEN_MIN_NR_GENS;
+	}
+	lru_gen_set_seq(page, seq);
+}
+
+/*
+ * How many generations have been opened since the page was last seen
+ * referenced, up to LRU_GEN_MAX_AGE.  A page without a generation counts
+ * as young.
+ */
+static inline unsigned long lru_gen_page_age(struct page *page)
+{
+	unsigned long gen = page_lru_gen(page);
+	unsigned long max_gen, age;
+
+	if (!gen)
+		return 0;
+	max_gen = lru_gen_from_seq(ACCESS_ONCE(lru_gen_max_seq));
+	age = (max_gen + LRU_GEN_NR_SEQ - gen) % LRU_GEN_NR_SEQ;
+	return min(age, LRU_GEN_MAX_AGE);
+}
+
+/* Called on context switch: the next aging walk has to look at this mm */
+static inline void lru_gen_use_mm(struct mm_struct *mm)
+{
+	if (lru_gen_enabled() && !test_bit(MMF_LRU_GEN_USED, &mm->flags))
+		set_bit(MMF_LRU_GEN_USED, &mm->flags);
+}
+
+void lru_gen_add_mm(struct mm_struct *mm);
+void lru_gen_del_mm(struct mm_struct *mm);
+void lru_gen_request_aging(void);
+void lru_gen_maybe_age(void);
+
+#else  /* !CONFIG_LRU_GEN */
+
+#define LRU_GEN_MIN_NR_GENS	2
+
+static inline int lru_gen_enabled(void)
+{
+	return 0;
+}
+
+static inline void lru_gen_touch_page(struct page *page)
+{
+}
+
+static inline void lru_gen_add_page(struct page *page)
+{
+}
+
+static inline unsigned long lru_gen_page_age(struct page *page)
+{
+	return 0;
+}
+
+static inline void lru_gen_use_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_add_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_del_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_request_aging(void)
+{
+}
+
+static inline void lru_gen_maybe_age(void)
+{
+}
+
+#endif /* !CONFIG_LRU_GEN */
+
+#endif /* __LINUX_LRU_GEN_H */
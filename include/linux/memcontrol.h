@@ -25,6 +25,22 @@ struct page_cgroup;
 struct page;
 struct mm_struct;
 
+/* Page cache states accounted per memcg for dirty throttling */
+enum mem_cgroup_page_stat_item {
+	MEMCG_NR_FILE_DIRTY,		/* # of dirty pages in page cache */
+	MEMCG_NR_FILE_WRITEBACK,	/* # of pages under writeback */
+	MEMCG_NR_FILE_UNSTABLE_NFS,	/* # of NFS unstable pages */
+};
+
+/* Dirty limits and dirty page counts of a memcg, in pages */
+struct mem_cgroup_dirty_info {
+	unsigned long background_thresh;
+	unsigned long dirty_thresh;
+	unsigned long nr_file_dirty;
+	unsigned long nr_writeback;
+	unsigned long nr_unstable_nfs;
+};
+
 extern unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
 					struct list_head *dst,
 					unsigned long *scanned, int order,
@@ -122,10 +138,19 @@ static inline bool mem_cgroup_disabled(void)
 }
 
 void mem_cgroup_update_file_mapped(struct page *page, int val);
+void mem_cgroup_update_page_stat(struct page *page,
+				 enum mem_cgroup_page_stat_item item, int val);
+bool mem_cgroup_dirty_info(unsigned long sys_available_mem,
+			   struct mem_cgroup_dirty_info *info);
+bool mem_cgroups_over_bground_dirty_thresh(void);
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask);
 u64 mem_cgroup_get_limit(struct mem_cgroup *mem);
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+void mem_cgroup_split_huge_fixup(struct page *head, struct page *tail);
+#endif
+
 #else /* CONFIG_CGROUP_MEM_RES_CTLR */
 struct mem_cgroup;
 
@@ -298,6 +323,22 @@ static inline void mem_cgroup_update_file_mapped(struct page *page,
 {
 }
 
+static inline void mem_cgroup_update_page_stat(struct page *page,
+				enum mem_cgroup_page_stat_item item, int val)
+{
+}
+
+static inline bool mem_cgroup_dirty_info(unsigned long sys_available_mem,
+					 struct mem_cgroup_dirty_info *info)
+{
+	return false;
+}
+
+static inline bool mem_cgroups_over_bground_dirty_thresh(void)
+{
+	return false;
+}
+
 static inline
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 					    gfp_t gfp_mask)
@@ -311,7 +352,24 @@ u64 mem_cgroup_get_limit(struct mem_cgroup *mem)
 	return 0;
 }
 
+static inline void mem_cgroup_split_huge_fixup(struct page *head,
+						struct page *tail)
+{
+}
+
 #endif /* CONFIG_CGROUP_MEM_CONT */
 
+static inline void mem_cgroup_inc_page_stat(struct page *page,
+					    enum mem_cgroup_page_stat_item item)
+{
+	mem_cgroup_update_page_stat(page, item, 1);
+}
+
+static inline void mem_cgroup_dec_page_stat(struct page *page,
+					    enum mem_cgroup_page_stat_item item)
+{
+	mem_cgroup_update_page_stat(page, item, -1);
+}
+
 #endif /* _LINUX_MEMCONTROL_H */
 
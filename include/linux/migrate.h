@@ -61,4 +61,15 @@ static inline int migrate_huge_page_move_mapping(struct address_space *mapping,
 #define fail_migrate_page NULL
 
 #endif /* CONFIG_MIGRATION */
+
+#ifdef CONFIG_NUMA_BALANCING
+extern int migrate_misplaced_page(struct page *page, int node);
+#else
+/* Consumes the caller's reference, like the real thing */
+static inline int migrate_misplaced_page(struct page *page, int node)
+{
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
 #endif /* _LINUX_MIGRATE_H */
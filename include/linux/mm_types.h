@@ -312,6 +312,19 @@ struct mm_struct {
 #endif
 	/* How many tasks sharing this mm are OOM_DISABLE */
 	atomic_t oom_disable_count;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	/* jiffies when the next range is made PROT_NONE for hinting faults */
+	unsigned long numa_next_scan;
+	/* where the next scan starts in the address space */
+	unsigned long numa_scan_offset;
+#endif
+#ifdef CONFIG_LRU_GEN
+	/* on the list of mms walked by lru_gen aging, under lru_gen_mm_lock */
+	struct list_head lru_gen_list;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
@@ -620,4 +620,33 @@ do {									\
 # define irqsafe_cpu_xor(pcp, val) __pcpu_size_call(irqsafe_cpu_xor_, (val))
 #endif
 
+/*
+ * cmpxchg_double replaces two adjacent per cpu scalars at once, if both
+ * still hold the expected old values.  A truth value is returned to
+ * indicate success or failure (since a double register result is
+ * difficult to handle).  Like the other irqsafe operations it is atomic
+ * vs. local interrupts and preemption only.
+ */
+#define irqsafe_generic_cpu_cmpxchg_double(pcp1, pcp2, oval1, oval2,	\
+					   nval1, nval2)		\
+({									\
+	int ret__;							\
+	unsigned long flags;						\
+	local_irq_save(flags);						\
+	ret__ = __this_cpu_read(pcp1) == (oval1) &&			\
+		__this_cpu_read(pcp2) == (oval2);			\
+	if (ret__) {							\
+		__this_cpu_write(pcp1, (nval1));			\
+		__this_cpu_write(pcp2, (nval2));			\
+	}								\
+	local_irq_restore(flags);					\
+	ret__;								\
+})
+
+#ifndef irqsafe_cpu_cmpxchg_double
+# define irqsafe_cpu_cmpxchg_double(pcp1, pcp2, oval1, oval2, nval1, nval2) \
+	irqsafe_generic_cpu_cmpxchg_double((pcp1), (pcp2), (oval1),	\
+					   (oval2), (nval1), (nval2))
+#endif
+
 #endif /* __LINUX_PERCPU_H */
@@ -7,6 +7,7 @@
 #define _LINUX_TICK_H
 
 #include <linux/clockchips.h>
+#include <linux/cpumask.h>
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -45,6 +46,11 @@ enum tick_nohz_mode {
  * @iowait_sleeptime:	Sum of the time slept in idle with sched tick stopped, with IO outstanding
  * @sleep_length:	Duration of the current idle sleep
  * @do_timer_lst:	CPU was the last one doing do_timer before going idle
+ * @full_stopped:	Indicator that the tick has been stopped while a single
+ *			task runs (full dynticks)
+ * @full_tick:		Tick expiry time when the tick was last stopped busy
+ * @full_jiffies:	jiffies up to which the busy cpu time was accounted
+ * @full_stops:		Number of times the tick was stopped busy
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -67,6 +73,12 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	int				full_stopped;
+	ktime_t				full_tick;
+	unsigned long			full_jiffies;
+	unsigned long			full_stops;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -139,4 +151,27 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+struct task_struct;
+
+# ifdef CONFIG_NO_HZ_FULL
+extern int tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+/* Is @cpu one of the nohz_full= cpus, which stop the tick when busy? */
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	return tick_nohz_full_running &&
+		cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void tick_nohz_full_check(void);
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_switch(struct task_struct *prev);
+# else
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_full_switch(struct task_struct *prev) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
@@ -593,6 +593,8 @@ static inline void set_notify_resume(struct task_struct *task)
  */
 static inline void tracehook_notify_resume(struct pt_regs *regs)
 {
+	/* NUMA balancing scans the address space from task context */
+	task_numa_work();
 }
 #endif	/* TIF_NOTIFY_RESUME */
 
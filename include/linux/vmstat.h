@@ -46,6 +46,8 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		KCOMPACTD_WAKE, KCOMPACTD_SUCCESS, KCOMPACTD_FAIL,
+		KCOMPACTD_PAGES,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -58,6 +60,24 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		UNEVICTABLE_PGCLEARED,	/* on COW, page truncate */
 		UNEVICTABLE_PGSTRANDED,	/* unable to isolate on unlock */
 		UNEVICTABLE_MLOCKFREED,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		THP_FAULT_ALLOC,
+		THP_FAULT_FALLBACK,
+		THP_COLLAPSE_ALLOC,
+		THP_COLLAPSE_ALLOC_FAILED,
+		THP_SPLIT,
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+		NUMA_PTE_UPDATES,	/* ptes made PROT_NONE for hinting */
+		NUMA_HINT_FAULTS,
+		NUMA_HINT_FAULTS_LOCAL,	/* page already on the faulting node */
+		NUMA_PAGE_MIGRATE,	/* misplaced pages moved */
+#endif
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING,		/* new generations opened */
+		LRU_GEN_MM_WALK,	/* page tables walked by aging */
+		LRU_GEN_YOUNG,		/* young ptes found by aging */
+#endif
 		NR_VM_EVENT_ITEMS
 };
 
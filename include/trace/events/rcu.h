@@ -0,0 +1,82 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rcu
+
+#if !defined(_TRACE_RCU_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_RCU_H
+
+#include <linux/tracepoint.h>
+
+/**
+ * rcu_nocb_queue - callbacks handed off to an rcuo kthread
+ * @rcuname:	name of the RCU flavor
+ * @cpu:	the CPU whose callbacks they are
+ * @count:	number of callbacks whose grace period just ended
+ * @qlen:	callbacks still queued on @cpu, waiting for a grace period
+ * @nocb_qlen:	callbacks now waiting for the kthread to invoke them
+ *
+ * This event occurs in RCU softirq context on a CPU listed in the
+ * "rcu_nocbs=" boot parameter, in place of invoking the callbacks.
+ */
+TRACE_EVENT(rcu_nocb_queue,
+
+	TP_PROTO(char *rcuname, int cpu, long count, long qlen, long nocb_qlen),
+
+	TP_ARGS(rcuname, cpu, count, qlen, nocb_qlen),
+
+	TP_STRUCT__entry(
+		__field( char *,	rcuname		)
+		__field( int,		cpu		)
+		__field( long,		count		)
+		__field( long,		qlen		)
+		__field( long,		nocb_qlen	)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname	= rcuname;
+		__entry->cpu		= cpu;
+		__entry->count		= count;
+		__entry->qlen		= qlen;
+		__entry->nocb_qlen	= nocb_qlen;
+	),
+
+	TP_printk("%s cpu=%d count=%ld qlen=%ld nocb_qlen=%ld",
+		  __entry->rcuname, __entry->cpu, __entry->count,
+		  __entry->qlen, __entry->nocb_qlen)
+);
+
+/**
+ * rcu_nocb_invoke - an rcuo kthread invoked a batch of callbacks
+ * @rcuname:	name of the RCU flavor
+ * @cpu:	the CPU whose callbacks they were
+ * @count:	number of callbacks invoked
+ * @latency:	ns from the hand-off of the oldest of them to its invocation
+ */
+TRACE_EVENT(rcu_nocb_invoke,
+
+	TP_PROTO(char *rcuname, int cpu, long count, u64 latency),
+
+	TP_ARGS(rcuname, cpu, count, latency),
+
+	TP_STRUCT__entry(
+		__field( char *,	rcuname		)
+		__field( int,		cpu		)
+		__field( long,		count		)
+		__field( u64,		latency		)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname	= rcuname;
+		__entry->cpu		= cpu;
+		__entry->count		= count;
+		__entry->latency	= latency;
+	),
+
+	TP_printk("%s cpu=%d count=%ld latency=%llu ns",
+		  __entry->rcuname, __entry->cpu, __entry->count,
+		  (unsigned long long)__entry->latency)
+);
+
+#endif /* _TRACE_RCU_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
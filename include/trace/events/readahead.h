@@ -0,0 +1,81 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+
+#define show_ra_pattern(pattern)					\
+	__print_symbolic(pattern,					\
+		{RA_PATTERN_INITIAL,		"initial"},		\
+		{RA_PATTERN_SUBSEQUENT,		"subsequent"},		\
+		{RA_PATTERN_CONTEXT,		"context"},		\
+		{RA_PATTERN_MARKER,		"marker"},		\
+		{RA_PATTERN_STRIDE,		"stride"},		\
+		{RA_PATTERN_BACKWARDS,		"backwards"},		\
+		{RA_PATTERN_OVERSIZE,		"oversize"},		\
+		{RA_PATTERN_MMAP_AROUND,	"mmap_around"},		\
+		{RA_PATTERN_RANDOM,		"random"})
+
+/*
+ * One readahead decision.  "miss" is a read that found the page not
+ * cached; "hit" is a read that reached a PG_readahead marker, i.e. the
+ * earlier readahead was in time.
+ */
+TRACE_EVENT(readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		 unsigned long req_size, unsigned int pattern,
+		 pgoff_t start, unsigned long size, unsigned long async_size,
+		 unsigned long actual, bool hit),
+
+	TP_ARGS(mapping, offset, req_size, pattern, start, size, async_size,
+		actual, hit),
+
+	TP_STRUCT__entry(
+		__field(	dev_t,		dev		)
+		__field(	ino_t,		ino		)
+		__field(	pgoff_t,	offset		)
+		__field(	unsigned long,	req_size	)
+		__field(	unsigned int,	pattern		)
+		__field(	pgoff_t,	start		)
+		__field(	unsigned long,	size		)
+		__field(	unsigned long,	async_size	)
+		__field(	unsigned long,	actual		)
+		__field(	bool,		hit		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= mapping->host->i_sb->s_dev;
+		__entry->ino		= mapping->host->i_ino;
+		__entry->offset		= offset;
+		__entry->req_size	= req_size;
+		__entry->pattern	= pattern;
+		__entry->start		= start;
+		__entry->size		= size;
+		__entry->async_size	= async_size;
+		__entry->actual		= actual;
+		__entry->hit		= hit;
+	),
+
+	TP_printk("dev %d:%d ino %lu %s %s offset=%lu req_size=%lu "
+		  "ra=(%lu+%lu-%lu) actual=%lu",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		(unsigned long)__entry->ino,
+		__entry->hit ? "hit" : "miss",
+		show_ra_pattern(__entry->pattern),
+		__entry->offset,
+		__entry->req_size,
+		__entry->start,
+		__entry->size,
+		__entry->async_size,
+		__entry->actual)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -1690,6 +1690,15 @@ void perf_event_task_tick(void)
 	}
 }
 
+/*
+ * Event rotation and frequency adjustment run from the tick: a nohz_full
+ * cpu keeps ticking while any context is on its rotation list.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -595,6 +596,9 @@ static void arm_timer(struct k_itimer *timer)
 				cputime_expires->sched_exp = exp->sched;
 			break;
 		}
+
+		/* cpu timers are checked from the tick */
+		tick_nohz_full_kick_cpu(task_cpu(p));
 	}
 }
 
@@ -1298,6 +1302,21 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Whether @tsk may run without the tick: cpu timers and itimers are only
+ * checked from run_posix_cpu_timers(), so none may be armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+	if (tsk->signal->cputimer.running)
+		return false;
+	return true;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
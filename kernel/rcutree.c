@@ -47,9 +47,15 @@
 #include <linux/mutex.h>
 #include <linux/time.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
+#include <linux/kthread.h>
+#include <linux/bootmem.h>
 
 #include "rcutree.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/rcu.h>
+
 /* Data structures. */
 
 static struct lock_class_key rcu_node_class[NUM_RCU_LVLS];
@@ -237,8 +243,12 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
-	/* If preemptable RCU, no point in sending reschedule IPI. */
-	if (rdp->preemptable)
+	/*
+	 * If preemptable RCU, no point in sending reschedule IPI, unless
+	 * the CPU runs tickless: the IPI is then what gets it to report a
+	 * quiescent state from user mode, see tick_nohz_full_check().
+	 */
+	if (rdp->preemptable && !tick_nohz_full_cpu(rdp->cpu))
 		return 0;
 
 	/* The CPU is online, so send it a reschedule IPI. */
@@ -1114,6 +1124,27 @@ static void rcu_offline_cpu(int cpu)
 
 #endif /* #else #ifdef CONFIG_HOTPLUG_CPU */
 
+/*
+ * Account for @count callbacks that have left @rdp's list, either
+ * invoked or handed off to an rcuo kthread.  Called with irqs disabled.
+ */
+static void rcu_dequeued_cbs(struct rcu_state *rsp, struct rcu_data *rdp,
+			     long count)
+{
+	rdp->qlen -= count;
+
+	/* Reinstate batch limit if we have worked down the excess. */
+	if (rdp->blimit == LONG_MAX && rdp->qlen <= qlowmark)
+		rdp->blimit = blimit;
+
+	/* Reset ->qlen_last_fqs_check trigger if enough CBs have drained. */
+	if (rdp->qlen == 0 && rdp->qlen_last_fqs_check != 0) {
+		rdp->qlen_last_fqs_check = 0;
+		rdp->n_force_qs_snap = rsp->n_force_qs;
+	} else if (rdp->qlen < rdp->qlen_last_fqs_check - qhimark)
+		rdp->qlen_last_fqs_check = rdp->qlen;
+}
+
 /*
  * Invoke any RCU callbacks that have made it to the end of their grace
  * period.  Thottle as specified by rdp->blimit.
@@ -1142,6 +1173,12 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 			rdp->nxttail[count] = &rdp->nxtlist;
 	local_irq_restore(flags);
 
+	/* Offloaded CPUs leave the invocation to their rcuo kthread. */
+	if (rcu_is_nocb_cpu(rdp->cpu)) {
+		rcu_nocb_queue_cbs(rsp, rdp, list, tail);
+		return;
+	}
+
 	/* Invoke callbacks. */
 	count = 0;
 	while (list) {
@@ -1157,7 +1194,7 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 	local_irq_save(flags);
 
 	/* Update count, and requeue any remaining callbacks. */
-	rdp->qlen -= count;
+	rcu_dequeued_cbs(rsp, rdp, count);
 	rdp->n_cbs_invoked += count;
 	if (list != NULL) {
 		*tail = rdp->nxtlist;
@@ -1169,17 +1206,6 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 				break;
 	}
 
-	/* Reinstate batch limit if we have worked down the excess. */
-	if (rdp->blimit == LONG_MAX && rdp->qlen <= qlowmark)
-		rdp->blimit = blimit;
-
-	/* Reset ->qlen_last_fqs_check trigger if enough CBs have drained. */
-	if (rdp->qlen == 0 && rdp->qlen_last_fqs_check != 0) {
-		rdp->qlen_last_fqs_check = 0;
-		rdp->n_force_qs_snap = rsp->n_force_qs;
-	} else if (rdp->qlen < rdp->qlen_last_fqs_check - qhimark)
-		rdp->qlen_last_fqs_check = rdp->qlen;
-
 	local_irq_restore(flags);
 
 	/* Re-raise the RCU softirq if there are callbacks remaining. */
@@ -1752,6 +1778,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	rdp->dynticks = &per_cpu(rcu_dynticks, cpu);
 #endif /* #ifdef CONFIG_NO_HZ */
 	rdp->cpu = cpu;
+	rcu_boot_init_nocb_percpu_data(rsp, rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -27,6 +27,8 @@
 #include <linux/threads.h>
 #include <linux/cpumask.h>
 #include <linux/seqlock.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
 
 /*
  * Define shape of hierarchy based on NR_CPUS and CONFIG_RCU_FANOUT.
@@ -234,6 +236,18 @@ struct rcu_data {
 	unsigned long n_rp_need_fqs;
 	unsigned long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 6) Callbacks offloaded to the rcuo kthread, see rcutree_plugin.h. */
+	struct rcu_head *nocb_head;	/* CBs waiting to be invoked. */
+	struct rcu_head **nocb_tail;
+	long nocb_qlen;			/* # CBs on ->nocb_head. */
+	ktime_t nocb_queued;		/* When the oldest of them was queued. */
+	raw_spinlock_t nocb_lock;	/* Protects the above. */
+	wait_queue_head_t nocb_wq;	/* The kthread sleeps here. */
+	struct task_struct *nocb_kthread;
+	struct rcu_state *rsp;		/* Flavor, for the kthread. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 };
 
@@ -393,5 +407,10 @@ static void __cpuinit rcu_preempt_init_percpu_data(int cpu);
 static void rcu_preempt_send_cbs_to_orphanage(void);
 static void __init __rcu_init_preempt(void);
 static void rcu_needs_cpu_flush(void);
+static bool rcu_is_nocb_cpu(int cpu);
+static void rcu_nocb_queue_cbs(struct rcu_state *rsp, struct rcu_data *rdp,
+			       struct rcu_head *list, struct rcu_head **tail);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_state *rsp,
+						  struct rcu_data *rdp);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
@@ -1133,3 +1133,189 @@ static void rcu_needs_cpu_flush(void)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offloaded callback invocation.  The CPUs listed in "rcu_nocbs=" still
+ * queue their callbacks and take part in grace periods as usual, but
+ * once a grace period has ended rcu_do_batch() hands the ready callbacks
+ * to an "rcuo" kthread per CPU and flavor instead of invoking them in
+ * softirq context.  The kthreads are not bound to their CPU: they start
+ * out on the CPUs that are not in the list, and can be moved with
+ * sched_setaffinity() like any other task.
+ */
+static cpumask_var_t rcu_nocb_mask;
+static bool have_rcu_nocb_mask;
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	return have_rcu_nocb_mask && cpumask_test_cpu(cpu, rcu_nocb_mask);
+}
+
+/*
+ * Queue the callbacks from @list to @tail, whose grace period has ended,
+ * for @rdp's rcuo kthread.  Called from rcu_do_batch() with irqs enabled.
+ */
+static void rcu_nocb_queue_cbs(struct rcu_state *rsp, struct rcu_data *rdp,
+			       struct rcu_head *list, struct rcu_head **tail)
+{
+	struct rcu_head *rhp;
+	unsigned long flags;
+	long count = 0;
+	long nocb_qlen;
+
+	/* The segments of ->nxtlist are not counted, so count this one. */
+	for (rhp = list; rhp; rhp = rhp->next)
+		count++;
+
+	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
+	if (!rdp->nocb_head)
+		rdp->nocb_queued = ktime_get();
+	*rdp->nocb_tail = list;
+	rdp->nocb_tail = tail;
+	rdp->nocb_qlen += count;
+	nocb_qlen = rdp->nocb_qlen;
+	raw_spin_unlock(&rdp->nocb_lock);	/* irqs remain disabled. */
+
+	rcu_dequeued_cbs(rsp, rdp, count);
+	trace_rcu_nocb_queue(rsp->name, rdp->cpu, count, rdp->qlen, nocb_qlen);
+	local_irq_restore(flags);
+
+	wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Per-CPU, per-flavor kthread that invokes the callbacks queued by
+ * rcu_nocb_queue_cbs(), oldest first, so rcu_barrier() still works.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_head *list, *next;
+	unsigned long flags;
+	ktime_t queued;
+	long count;
+
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+
+		raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
+		list = rdp->nocb_head;
+		rdp->nocb_head = NULL;
+		rdp->nocb_tail = &rdp->nocb_head;
+		count = rdp->nocb_qlen;
+		rdp->nocb_qlen = 0;
+		queued = rdp->nocb_queued;
+		raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
+		if (!list)
+			continue;
+
+		trace_rcu_nocb_invoke(rdp->rsp->name, rdp->cpu, count,
+				      ktime_to_ns(ktime_sub(ktime_get(), queued)));
+
+		/* Callbacks expect the softirq context they normally run in. */
+		while (list) {
+			next = list->next;
+			prefetch(next);
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			list->func(list);
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+		rdp->n_cbs_invoked += count;
+	}
+	return 0;
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_state *rsp,
+						  struct rcu_data *rdp)
+{
+	rdp->rsp = rsp;
+	rdp->nocb_tail = &rdp->nocb_head;
+	raw_spin_lock_init(&rdp->nocb_lock);
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+static void __init rcu_spawn_nocb_kthreads_one(struct rcu_state *rsp,
+					       const struct cpumask *housekeeping)
+{
+	struct rcu_data *rdp;
+	struct task_struct *t;
+	int cpu;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (!cpu_possible(cpu))
+			continue;
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		/* rsp->name[4] is 's', 'b' or 'p', for sched, bh and preempt */
+		t = kthread_create(rcu_nocb_kthread, rdp, "rcuo%c/%d",
+				   rsp->name[4], cpu);
+		if (WARN_ON_ONCE(IS_ERR(t)))
+			continue;
+		if (!cpumask_empty(housekeeping))
+			set_cpus_allowed_ptr(t, housekeeping);
+		rdp->nocb_kthread = t;
+		wake_up_process(t);
+	}
+}
+
+/*
+ * Callbacks handed off before the kthreads exist just wait for them.
+ * Failing to create a kthread strands its CPU's callbacks, hence the
+ * warning.
+ */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	cpumask_var_t housekeeping;
+	char buf[128];
+
+	if (!have_rcu_nocb_mask || cpumask_empty(rcu_nocb_mask))
+		return 0;
+	if (!zalloc_cpumask_var(&housekeeping, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(housekeeping, cpu_possible_mask, rcu_nocb_mask);
+
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "RCU: offloading callbacks from CPUs %s.\n", buf);
+	rcu_spawn_nocb_kthreads_one(&rcu_sched_state, housekeeping);
+	rcu_spawn_nocb_kthreads_one(&rcu_bh_state, housekeeping);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads_one(&rcu_preempt_state, housekeeping);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+	free_cpumask_var(housekeeping);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static void rcu_nocb_queue_cbs(struct rcu_state *rsp, struct rcu_data *rdp,
+			       struct rcu_head *list, struct rcu_head **tail)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_state *rsp,
+						  struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -72,6 +72,7 @@
 #include <linux/ctype.h>
 #include <linux/ftrace.h>
 #include <linux/slab.h>
+#include <linux/lru_gen.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -268,6 +269,10 @@ struct task_group {
 	struct task_group *parent;
 	struct list_head siblings;
 	struct list_head children;
+
+#ifdef CONFIG_SCHED_AUTOGROUP
+	struct autogroup *autogroup;
+#endif
 };
 
 #define root_task_group init_task_group
@@ -517,6 +522,9 @@ struct rq {
 	u64 age_stamp;
 	u64 idle_stamp;
 	u64 avg_idle;
+
+	/* tasks queued by remote wakers, enqueued by scheduler_ipi() */
+	struct task_struct *wake_list;
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
@@ -552,6 +560,7 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+	unsigned int ttwu_queued;
 
 	/* BKL stats */
 	unsigned int bkl_count;
@@ -603,6 +612,8 @@ static inline int cpu_of(struct rq *rq)
 #define cpu_curr(cpu)		(cpu_rq(cpu)->curr)
 #define raw_rq()		(&__raw_get_cpu_var(runqueues))
 
+#include "sched_autogroup.h"
+
 #ifdef CONFIG_CGROUP_SCHED
 
 /*
@@ -615,11 +626,14 @@ static inline int cpu_of(struct rq *rq)
  */
 static inline struct task_group *task_group(struct task_struct *p)
 {
+	struct task_group *tg;
 	struct cgroup_subsys_state *css;
 
 	css = task_subsys_state_check(p, cpu_cgroup_subsys_id,
 			lockdep_is_held(&task_rq(p)->lock));
-	return container_of(css, struct task_group, css);
+	tg = container_of(css, struct task_group, css);
+
+	return autogroup_task_group(p, tg);
 }
 
 /* Change a task's cfs_rq and parent entity if it moves across CPUs/groups */
@@ -1542,6 +1556,10 @@ static unsigned long power_of(int cpu)
 
 static int task_hot(struct task_struct *p, u64 now, struct sched_domain *sd);
 
+#ifdef CONFIG_NUMA_BALANCING
+static void sched_numa_move(int nid);
+#endif
+
 static unsigned long cpu_avg_load_per_task(int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
@@ -1863,6 +1881,10 @@ static const struct sched_class rt_sched_class;
 static void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+	/* A second task needs the tick back for preemption */
+	if (rq->nr_running == 2)
+		tick_nohz_full_kick_cpu(cpu_of(rq));
 }
 
 static void dec_nr_running(struct rq *rq)
@@ -2017,6 +2039,7 @@ static void sched_irq_time_avg_update(struct rq *rq, u64 curr_irq_time) { }
 #include "sched_fair.c"
 #include "sched_rt.c"
 #include "sched_stoptask.c"
+#include "sched_autogroup.c"
 #ifdef CONFIG_SCHED_DEBUG
 # include "sched_debug.c"
 #endif
@@ -2459,6 +2482,123 @@ static inline void ttwu_post_activation(struct task_struct *p, struct rq *rq,
 		wq_worker_waking_up(p, cpu_of(rq));
 }
 
+#ifdef CONFIG_SMP
+/*
+ * Finish the wakeups remote cpus queued on this one.  Each task was put in
+ * TASK_WAKING and had its cpu set by the waker, exactly as on the direct
+ * path, so all that is left is the part that needs our rq->lock.  The
+ * enqueue flags are the ones the waker chose when it called task_waking().
+ */
+static void sched_ttwu_pending(void)
+{
+	struct rq *rq = this_rq();
+	struct task_struct *list = xchg(&rq->wake_list, NULL);
+	unsigned long en_flags;
+	int wake_flags;
+
+	if (!list)
+		return;
+
+	raw_spin_lock(&rq->lock);
+	while (list) {
+		struct task_struct *p = list;
+
+		list = list->wake_entry;
+		WARN_ON(task_cpu(p) != cpu_of(rq));
+		WARN_ON(p->state != TASK_WAKING);
+
+		schedstat_inc(rq, ttwu_count);
+		schedstat_inc(rq, ttwu_queued);
+		en_flags = p->wake_en_flags;
+		wake_flags = p->wake_flags;
+
+		/*
+		 * task_rq_lock() does not keep a TASK_WAKING task from
+		 * changing class while it sits on the list.  A vruntime the
+		 * waker made relative must be made absolute again if the
+		 * task is no longer fair; one it left absolute is handled
+		 * by a plain ENQUEUE_WAKEUP if the task has become fair.
+		 */
+		if ((en_flags & ENQUEUE_WAKING) && !p->sched_class->task_waking) {
+			p->se.vruntime += cfs_rq_of(&p->se)->min_vruntime;
+			en_flags &= ~ENQUEUE_WAKING;
+		}
+
+		ttwu_activate(p, rq, wake_flags & WF_SYNC,
+			      wake_flags & WF_MIGRATED, false, en_flags);
+		ttwu_post_activation(p, rq, 0, true);
+	}
+	raw_spin_unlock(&rq->lock);
+}
+
+/*
+ * Called from the reschedule IPI, with interrupts disabled.
+ */
+void scheduler_ipi(void)
+{
+	/*
+	 * A nohz_full cpu is also kicked with this IPI, to reevaluate its
+	 * tick and report quiescent states to RCU on irq_exit().
+	 */
+	if (!this_rq()->wake_list && !tick_nohz_full_cpu(smp_processor_id()))
+		return;
+
+	/*
+	 * The IPI may have woken us from idle: tell nohz and RCU that we
+	 * are in an interrupt before activating tasks.
+	 */
+	irq_enter();
+	sched_ttwu_pending();
+	irq_exit();
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Whether the tick can be stopped on a busy nohz_full cpu: only a
+ * single runnable task can do without preemption by the tick.
+ */
+bool sched_can_stop_tick(void)
+{
+	return this_rq()->nr_running <= 1;
+}
+#endif
+
+/*
+ * Push @p onto @cpu's wake list; only the first task queued on an empty
+ * list needs to send the IPI, later ones ride along with it.
+ */
+static void ttwu_queue_remote(struct task_struct *p, int cpu, int wake_flags,
+			      unsigned long en_flags)
+{
+	struct rq *rq = cpu_rq(cpu);
+	struct task_struct *next = rq->wake_list;
+
+	p->wake_flags = wake_flags;
+	p->wake_en_flags = en_flags;
+
+	for (;;) {
+		struct task_struct *old = next;
+
+		p->wake_entry = next;
+		next = cmpxchg(&rq->wake_list, old, p);
+		if (next == old)
+			break;
+	}
+
+	if (!next)
+		smp_send_reschedule(cpu);
+}
+
+static inline bool ttwu_want_queue(int cpu, int this_cpu)
+{
+#ifdef CONFIG_HAVE_SCHEDULER_IPI
+	return sched_feat(TTWU_QUEUE) && cpu != this_cpu;
+#else
+	return false;
+#endif
+}
+#endif /* CONFIG_SMP */
+
 /**
  * try_to_wake_up - wake up a thread
  * @p: the thread to be awakened
@@ -2523,6 +2663,33 @@ static int try_to_wake_up(struct task_struct *p, unsigned int state,
 		set_task_cpu(p, cpu);
 	__task_rq_unlock(rq);
 
+#ifdef CONFIG_SCHEDSTATS
+	if (cpu != this_cpu) {
+		struct sched_domain *sd;
+		for_each_domain(this_cpu, sd) {
+			if (cpumask_test_cpu(cpu, sched_domain_span(sd))) {
+				schedstat_inc(sd, ttwu_wake_remote);
+				break;
+			}
+		}
+	}
+#endif /* CONFIG_SCHEDSTATS */
+
+	/*
+	 * The task stays TASK_WAKING until the target cpu has enqueued it,
+	 * which keeps concurrent wakeups and ->cpus_allowed changes away.
+	 * Offlining the target needs stop_machine, which cannot run while
+	 * we hold preemption off, so it will see the queued task.
+	 */
+	if (ttwu_want_queue(cpu, this_cpu)) {
+		if (cpu != orig_cpu)
+			wake_flags |= WF_MIGRATED;
+		ttwu_queue_remote(p, cpu, wake_flags, en_flags);
+		local_irq_restore(flags);
+		put_cpu();
+		return 1;
+	}
+
 	rq = cpu_rq(cpu);
 	raw_spin_lock(&rq->lock);
 
@@ -2535,20 +2702,9 @@ static int try_to_wake_up(struct task_struct *p, unsigned int state,
 	WARN_ON(task_cpu(p) != cpu);
 	WARN_ON(p->state != TASK_WAKING);
 
-#ifdef CONFIG_SCHEDSTATS
 	schedstat_inc(rq, ttwu_count);
 	if (cpu == this_cpu)
 		schedstat_inc(rq, ttwu_local);
-	else {
-		struct sched_domain *sd;
-		for_each_domain(this_cpu, sd) {
-			if (cpumask_test_cpu(cpu, sched_domain_span(sd))) {
-				schedstat_inc(sd, ttwu_wake_remote);
-				break;
-			}
-		}
-	}
-#endif /* CONFIG_SCHEDSTATS */
 
 out_activate:
 #endif /* CONFIG_SMP */
@@ -2986,8 +3142,10 @@ context_switch(struct rq *rq, struct task_struct *prev,
 		next->active_mm = oldmm;
 		atomic_inc(&oldmm->mm_count);
 		enter_lazy_tlb(oldmm, next);
-	} else
+	} else {
 		switch_mm(oldmm, mm, next);
+		lru_gen_use_mm(mm);
+	}
 
 	if (!prev->mm) {
 		prev->active_mm = NULL;
@@ -3360,6 +3518,42 @@ unlock:
 	task_rq_unlock(rq, &flags);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Move current to an idle cpu on node @nid, where most of its memory
+ * faults were seen.  Nothing is done if no such cpu is idle: the load
+ * balancer will pull the task over when it gets the chance.
+ */
+static void sched_numa_move(int nid)
+{
+	struct task_struct *p = current;
+	unsigned long flags;
+	struct rq *rq;
+	int cpu, dest_cpu = -1;
+
+	for_each_cpu_and(cpu, cpumask_of_node(nid), &p->cpus_allowed) {
+		if (cpu_active(cpu) && idle_cpu(cpu)) {
+			dest_cpu = cpu;
+			break;
+		}
+	}
+	if (dest_cpu < 0)
+		return;
+
+	rq = task_rq_lock(p, &flags);
+	/* the mask could have changed since we looked */
+	if (cpumask_test_cpu(dest_cpu, &p->cpus_allowed) &&
+	    likely(cpu_active(dest_cpu)) && migrate_task(p, dest_cpu)) {
+		struct migration_arg arg = { p, dest_cpu };
+
+		task_rq_unlock(rq, &flags);
+		stop_one_cpu(cpu_of(rq), migration_cpu_stop, &arg);
+		return;
+	}
+	task_rq_unlock(rq, &flags);
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 #endif
 
 DEFINE_PER_CPU(struct kernel_stat, kstat);
@@ -3862,6 +4056,18 @@ pick_next_task(struct rq *rq)
 	BUG(); /* the idle class will always have a runnable task */
 }
 
+static inline void sched_submit_work(struct task_struct *tsk)
+{
+	if (!tsk->state || (preempt_count() & PREEMPT_ACTIVE))
+		return;
+	/*
+	 * If we are going to sleep and we have plugged IO queued,
+	 * make sure to submit it to avoid deadlocks.
+	 */
+	if (blk_needs_flush_plug(tsk))
+		blk_flush_plug(tsk);
+}
+
 /*
  * schedule() is the main scheduler function.
  */
@@ -3872,6 +4078,7 @@ asmlinkage void __sched schedule(void)
 	struct rq *rq;
 	int cpu;
 
+	sched_submit_work(current);
 need_resched:
 	preempt_disable();
 	cpu = smp_processor_id();
@@ -3924,6 +4131,7 @@ need_resched_nonpreemptible:
 	if (likely(prev != next)) {
 		sched_info_switch(prev, next);
 		perf_event_task_sched_out(prev, next);
+		tick_nohz_full_switch(prev);
 
 		rq->nr_switches++;
 		rq->curr = next;
@@ -6115,6 +6323,8 @@ migration_call(struct notifier_block *nfb, unsigned long action, void *hcpu)
 
 	case CPU_DYING:
 	case CPU_DYING_FROZEN:
+		/* Enqueue wakeups queued before stop_machine, then migrate them */
+		sched_ttwu_pending();
 		/* Update our root-domain */
 		raw_spin_lock_irqsave(&rq->lock, flags);
 		if (rq->rd) {
@@ -7962,6 +8172,7 @@ void __init sched_init(void)
 #ifdef CONFIG_CGROUP_SCHED
 	list_add(&init_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&init_task_group.children);
+	autogroup_init(&init_task);
 
 #endif /* CONFIG_CGROUP_SCHED */
 
@@ -8422,6 +8633,7 @@ static void free_sched_group(struct task_group *tg)
 {
 	free_fair_sched_group(tg);
 	free_rt_sched_group(tg);
+	autogroup_free(tg);
 	kfree(tg);
 }
 
@@ -22,6 +22,8 @@
 
 #include <linux/latencytop.h>
 #include <linux/sched.h>
+#include <linux/mempolicy.h>
+#include <linux/hugetlb.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -91,6 +93,178 @@ const_debug unsigned int sysctl_sched_migration_cost = 500000UL;
 
 static const struct sched_class fair_sched_class;
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA placement.
+ *
+ * Every scan period one thread of each mm makes the next
+ * sysctl_numa_balancing_scan_size MB of its address space PROT_NONE, from
+ * task context on the way back to user mode.  The next access to each of
+ * those pages takes a NUMA hinting fault, which restores the protection,
+ * moves the page to the faulting node if that is where the task is settled,
+ * and counts the fault against the node the page was on.  The node with the
+ * most (decaying) faults becomes the task's preferred node: the task is
+ * moved to an idle cpu there, and the load balancer resists moving it away.
+ */
+unsigned int sysctl_numa_balancing __read_mostly;
+
+/* how long a new mm runs before it is first scanned, in ms */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/* time between two scans of the same mm, in ms; faults decay at this rate */
+unsigned int sysctl_numa_balancing_scan_period = 1000;
+
+/* how much address space one scan makes PROT_NONE, in MB */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+
+void task_numa_fault(int node, int pages)
+{
+	struct task_struct *p = current;
+	unsigned long now = jiffies;
+	int preferred, nid;
+	bool settle = false;
+
+	if (unlikely(!p->numa_faults)) {
+		p->numa_faults = kzalloc(sizeof(*p->numa_faults) * nr_node_ids,
+					 GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+		p->numa_preferred_nid = -1;
+		p->numa_faults_decay = now;
+	}
+
+	/* forget old placement slowly, so a phase change can win */
+	if (time_after_eq(now, p->numa_faults_decay)) {
+		for_each_node(nid)
+			p->numa_faults[nid] /= 2;
+		p->numa_faults_decay = now +
+			msecs_to_jiffies(sysctl_numa_balancing_scan_period);
+		settle = true;
+	}
+
+	p->numa_faults[node] += pages;
+	preferred = p->numa_preferred_nid;
+	if (preferred == -1 ||
+	    p->numa_faults[node] > p->numa_faults[preferred]) {
+		settle |= node != preferred;
+		p->numa_preferred_nid = preferred = node;
+	}
+
+	if (settle && cpu_to_node(task_cpu(p)) != preferred)
+		sched_numa_move(preferred);
+}
+
+/*
+ * Called on return to user mode once task_tick_numa() found the mm due for
+ * a scan.  Picks up where the previous scan of this mm stopped.
+ */
+void task_numa_work(void)
+{
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long now = jiffies;
+	unsigned long migrate, next_scan;
+	unsigned long start, end, pages;
+
+	if (!sysctl_numa_balancing || !mm || (p->flags & PF_EXITING))
+		return;
+
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+
+	/* only one thread of the mm does the scan */
+	next_scan = now + msecs_to_jiffies(sysctl_numa_balancing_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = (unsigned long)sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT;
+	start = mm->numa_scan_offset;
+
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, start);
+	if (!vma) {
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma && pages; vma = vma->vm_next) {
+		if (!vma_migratable(vma) || is_vm_hugetlb_page(vma))
+			continue;
+		/* inaccessible, or shared read-only text: nothing to learn */
+		if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+			continue;
+		if (vma->vm_file &&
+		    (vma->vm_flags & (VM_READ | VM_WRITE)) == VM_READ)
+			continue;
+
+		start = max(start, vma->vm_start);
+		end = min(vma->vm_end, start + (pages << PAGE_SHIFT));
+		change_prot_numa(vma, start, end);
+		pages -= (end - start) >> PAGE_SHIFT;
+		start = end;
+		if (end != vma->vm_end)
+			break;
+	}
+	/* wrap around at the end of the address space */
+	mm->numa_scan_offset = vma ? start : 0;
+	up_read(&mm->mmap_sem);
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	if (!sysctl_numa_balancing || !curr->mm ||
+	    (curr->flags & PF_EXITING))
+		return;
+
+	if (time_before(jiffies, curr->mm->numa_next_scan))
+		return;
+
+	/* task_numa_work() runs on the way back to user mode */
+	if (!test_tsk_thread_flag(curr, TIF_NOTIFY_RESUME))
+		set_tsk_thread_flag(curr, TIF_NOTIFY_RESUME);
+}
+
+/*
+ * > 0 if moving @p from @src_cpu to @dst_cpu takes it to its preferred
+ * node, < 0 if it takes it away from there, 0 otherwise.
+ */
+static int task_numa_locality(struct task_struct *p, int src_cpu, int dst_cpu)
+{
+	int nid = p->numa_preferred_nid;
+	int src_nid, dst_nid;
+
+	if (!sysctl_numa_balancing || !p->numa_faults || nid == -1)
+		return 0;
+
+	src_nid = cpu_to_node(src_cpu);
+	dst_nid = cpu_to_node(dst_cpu);
+	if (src_nid == dst_nid)
+		return 0;
+	if (dst_nid == nid)
+		return 1;
+	if (src_nid == nid)
+		return -1;
+	return 0;
+}
+#else
+static inline void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+
+static inline int
+task_numa_locality(struct task_struct *p, int src_cpu, int dst_cpu)
+{
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /**************************************************************
  * CFS operations on generic schedulable entities:
  */
@@ -1779,11 +1953,13 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 		     int *all_pinned)
 {
 	int tsk_cache_hot = 0;
+	int numa;
 	/*
 	 * We do not migrate tasks that are:
 	 * 1) running (obviously), or
 	 * 2) cannot be migrated to this CPU due to cpus_allowed, or
-	 * 3) are cache-hot on their current CPU.
+	 * 3) are cache-hot on their current CPU, or would leave the
+	 *    node holding most of their memory.
 	 */
 	if (!cpumask_test_cpu(this_cpu, &p->cpus_allowed)) {
 		schedstat_inc(p, se.statistics.nr_failed_migrations_affine);
@@ -1802,7 +1978,11 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 	 * 2) too many balance attempts have failed.
 	 */
 
-	tsk_cache_hot = task_hot(p, rq->clock_task, sd);
+	numa = task_numa_locality(p, cpu_of(rq), this_cpu);
+	if (numa > 0)
+		return 1;
+
+	tsk_cache_hot = task_hot(p, rq->clock_task, sd) || numa < 0;
 	if (!tsk_cache_hot ||
 		sd->nr_balance_failed > sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -3774,6 +3954,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
@@ -3880,14 +4062,19 @@ static void task_move_group_fair(struct task_struct *p, int on_rq)
 	 * If it was on the rq, we've just 'preempted' it, which does convert
 	 * ->vruntime to a relative base.
 	 *
+	 * A task that is being woken up (TASK_WAKING, possibly still queued
+	 * on a remote cpu's wake list) has already had its ->vruntime made
+	 * relative by task_waking_fair(), and the ENQUEUE_WAKING enqueue will
+	 * add the new cfs_rq's min_vruntime back: leave it alone.
+	 *
 	 * Make sure both cases convert their relative position when migrating
 	 * to another cgroup's rq. This does somewhat interfere with the
 	 * fair sleeper stuff for the first placement, but who cares.
 	 */
-	if (!on_rq)
+	if (!on_rq && p->state != TASK_WAKING)
 		p->se.vruntime -= cfs_rq_of(&p->se)->min_vruntime;
 	set_task_rq(p, task_cpu(p));
-	if (!on_rq)
+	if (!on_rq && p->state != TASK_WAKING)
 		p->se.vruntime += cfs_rq_of(&p->se)->min_vruntime;
 }
 #endif
@@ -66,3 +66,10 @@ SCHED_FEAT(OWNER_SPIN, 1)
  * Decrement CPU power based on irq activity
  */
 SCHED_FEAT(NONIRQ_POWER, 1)
+
+/*
+ * Queue remote wakeups on the target cpu's wake list and let it do the
+ * enqueue from the reschedule IPI, rather than taking its rq->lock from
+ * the waking cpu.
+ */
+SCHED_FEAT(TTWU_QUEUE, 1)
@@ -531,8 +531,9 @@ void tick_broadcast_setup_oneshot(struct clock_event_device *bc)
 		bc->event_handler = tick_handle_oneshot_broadcast;
 		clockevents_set_mode(bc, CLOCK_EVT_MODE_ONESHOT);
 
-		/* Take the do_timer update */
-		tick_do_timer_cpu = cpu;
+		/* Take the do_timer update, unless we may stop ticking busy */
+		if (!tick_nohz_full_cpu(cpu))
+			tick_do_timer_cpu = cpu;
 
 		/*
 		 * We must be careful here. There might be other CPUs
@@ -284,14 +284,20 @@ out_bc:
 }
 
 /*
- * Transfer the do_timer job away from a dying cpu.
+ * Transfer the do_timer job away from a dying cpu.  A nohz_full cpu is
+ * never chosen, as it stops its tick while busy.
  *
  * Called with interrupts disabled.
  */
 static void tick_handover_do_timer(int *cpup)
 {
 	if (*cpup == tick_do_timer_cpu) {
-		int cpu = cpumask_first(cpu_online_mask);
+		int cpu;
+
+		for_each_online_cpu(cpu) {
+			if (!tick_nohz_full_cpu(cpu))
+				break;
+		}
 
 		tick_do_timer_cpu = (cpu < nr_cpu_ids) ? cpu :
 			TICK_DO_TIMER_NONE;
@@ -21,6 +21,9 @@
 #include <linux/sched.h>
 #include <linux/tick.h>
 #include <linux/module.h>
+#include <linux/irq_work.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
 
 #include <asm/irq_regs.h>
 
@@ -124,6 +127,38 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: the cpus in tick_nohz_full_mask also stop their tick
+ * while they run a single task, see tick_nohz_full_check().  The boot
+ * cpu stays out of the mask and keeps the timekeeping duty.
+ */
+int tick_nohz_full_running __read_mostly;
+cpumask_var_t tick_nohz_full_mask;
+
+static int __init setup_tick_nohz_full(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	return 1;
+}
+__setup("nohz_full=", setup_tick_nohz_full);
+
+static void __tick_nohz_full_restart(struct tick_sched *ts, ktime_t now);
+#endif
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -277,6 +312,16 @@ void tick_nohz_stop_sched_tick(int inidle)
 	if (!inidle && !ts->inidle)
 		goto end;
 
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * The busy tick stop does not carry over into idle.  The stretch
+	 * it covered was charged to the task that ran it, when it was
+	 * switched out; there is nothing here to charge it to.
+	 */
+	if (ts->full_stopped)
+		__tick_nohz_full_restart(ts, ktime_get());
+#endif
+
 	/*
 	 * Set ts->inidle unconditionally. Even if the system did not
 	 * switch to NOHZ mode the cpu frequency governers rely on the
@@ -340,6 +385,15 @@ void tick_nohz_stop_sched_tick(int inidle)
 	if (!ts->tick_stopped && delta_jiffies == 1)
 		goto out;
 
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * Busy nohz_full cpus rely on the timekeeping cpu to update
+	 * jiffies, so that one keeps ticking even when idle.
+	 */
+	if (tick_nohz_full_running && cpu == tick_do_timer_cpu)
+		goto out;
+#endif
+
 	/* Schedule the tick, if we are at least one jiffie off */
 	if ((long)delta_jiffies >= 1) {
 
@@ -465,10 +519,11 @@ ktime_t tick_nohz_get_sleep_length(void)
 	return ts->sleep_length;
 }
 
-static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
+static void tick_nohz_restart(struct tick_sched *ts, ktime_t last_tick,
+			      ktime_t now)
 {
 	hrtimer_cancel(&ts->sched_timer);
-	hrtimer_set_expires(&ts->sched_timer, ts->idle_tick);
+	hrtimer_set_expires(&ts->sched_timer, last_tick);
 
 	while (1) {
 		/* Forward the time to expire in the future */
@@ -548,11 +603,213 @@ void tick_nohz_restart_sched_tick(void)
 	ts->tick_stopped  = 0;
 	ts->idle_exittime = now;
 
-	tick_nohz_restart(ts, now);
+	tick_nohz_restart(ts, ts->idle_tick, now);
 
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * The residual tick: a busy tickless cpu still ticks at least once a
+ * second, which keeps the scheduler, load and cputime statistics of the
+ * running task from going stale.
+ */
+#define TICK_NOHZ_FULL_MAX_JIFFIES	HZ
+
+/*
+ * Charge the ticks that did not happen while the tick was stopped, less
+ * @skip that the caller accounts itself, to @p.
+ */
+static void __tick_nohz_full_account(struct tick_sched *ts,
+				     struct task_struct *p, int user_tick,
+				     int hardirq_offset, unsigned long skip)
+{
+	unsigned long ticks = jiffies - ts->full_jiffies;
+	cputime_t delta;
+
+	ts->full_jiffies = jiffies;
+	if (ticks <= skip || ticks >= LONG_MAX)
+		return;
+
+	delta = jiffies_to_cputime(ticks - skip);
+	if (user_tick)
+		account_user_time(p, delta, cputime_to_scaled(delta));
+	else
+		account_system_time(p, hardirq_offset, delta,
+				    cputime_to_scaled(delta));
+}
+
+/* As above, to the current task; where it was interrupted decides the mode */
+static void tick_nohz_full_account(struct tick_sched *ts, int hardirq_offset,
+				   unsigned long skip)
+{
+	struct pt_regs *regs = get_irq_regs();
+
+	__tick_nohz_full_account(ts, current, regs && user_mode(regs),
+				 hardirq_offset, skip);
+}
+
+static bool tick_nohz_full_can_stop(int cpu)
+{
+	/* a second task needs the tick for preemption */
+	if (!sched_can_stop_tick())
+		return false;
+	/* cpu timers and event multiplexing are driven by the tick */
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+	if (!perf_event_can_stop_tick())
+		return false;
+	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
+	    arch_needs_cpu(cpu))
+		return false;
+	if (local_softirq_pending())
+		return false;
+	return true;
+}
+
+static void __tick_nohz_full_restart(struct tick_sched *ts, ktime_t now)
+{
+	ts->full_stopped = 0;
+	tick_nohz_restart(ts, ts->full_tick, now);
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts, ktime_t now)
+{
+	tick_nohz_full_account(ts, 0, 0);
+	__tick_nohz_full_restart(ts, now);
+}
+
+static void tick_nohz_full_stop_tick(struct tick_sched *ts)
+{
+	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
+	int was_stopped = ts->full_stopped;
+	ktime_t last_update, expires;
+
+	/*
+	 * Mark the tick stopped before looking at the timer wheel, so that
+	 * tick_nohz_full_kick_cpu() cannot miss a timer added meanwhile.
+	 */
+	ts->full_stopped = 1;
+	smp_mb();
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	next_jiffies = get_next_timer_interrupt(last_jiffies);
+	delta_jiffies = next_jiffies - last_jiffies;
+	if ((long)delta_jiffies <= 1) {
+		if (was_stopped)
+			tick_nohz_full_restart(ts, ktime_get());
+		else
+			ts->full_stopped = 0;
+		return;
+	}
+
+	delta_jiffies = min_t(unsigned long, delta_jiffies,
+			      TICK_NOHZ_FULL_MAX_JIFFIES);
+	expires = ktime_add_ns(last_update, tick_period.tv64 * delta_jiffies);
+
+	if (!was_stopped) {
+		ts->full_tick = hrtimer_get_expires(&ts->sched_timer);
+		ts->full_jiffies = last_jiffies;
+		ts->full_stops++;
+	} else if (ktime_equal(expires,
+			       hrtimer_get_expires(&ts->sched_timer))) {
+		return;
+	}
+
+	hrtimer_start(&ts->sched_timer, expires, HRTIMER_MODE_ABS_PINNED);
+	/* Check, if the timer was already in the past */
+	if (!hrtimer_active(&ts->sched_timer))
+		tick_nohz_full_restart(ts, ktime_get());
+}
+
+/**
+ * tick_nohz_full_check - stop or restart the tick of a busy nohz_full cpu
+ *
+ * Called from irq_exit() with interrupts disabled.  When the cpu runs a
+ * single task and nothing else needs the tick, the tick is pushed out to
+ * the next timer wheel event, at most TICK_NOHZ_FULL_MAX_JIFFIES away;
+ * otherwise a stopped tick is restarted.
+ */
+void tick_nohz_full_check(void)
+{
+	int cpu = smp_processor_id();
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+	struct pt_regs *regs;
+
+	if (!tick_nohz_full_cpu(cpu) || ts->inidle || idle_cpu(cpu))
+		return;
+	if (ts->nohz_mode != NOHZ_MODE_HIGHRES)
+		return;
+
+	/*
+	 * Without the tick, the interrupts the grace period machinery
+	 * sends us are where we tell RCU that user mode is quiescent.
+	 */
+	regs = get_irq_regs();
+	if (ts->full_stopped && regs && user_mode(regs))
+		rcu_check_callbacks(cpu, 1);
+
+	if (tick_nohz_full_can_stop(cpu))
+		tick_nohz_full_stop_tick(ts);
+	else if (ts->full_stopped)
+		tick_nohz_full_restart(ts, ktime_get());
+}
+
+/**
+ * tick_nohz_full_switch - charge the tickless stretch to the task leaving
+ * @prev: the task being switched out
+ *
+ * Called from schedule() with interrupts disabled.  When the single task
+ * blocks or exits, the tick is only restarted later, from whatever runs
+ * next or from the idle loop, so the time it ran without a tick has to be
+ * charged to it here.  Without the interrupted registers to go by, a user
+ * task's stretch counts as user time and a kernel thread's as system time.
+ */
+void tick_nohz_full_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	if (!ts->full_stopped)
+		return;
+
+	__tick_nohz_full_account(ts, prev, !(prev->flags & PF_KTHREAD), 0, 0);
+}
+
+static void tick_nohz_full_kick_work(struct irq_work *work)
+{
+	/* Nothing to do: irq_exit() reevaluates the tick */
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = tick_nohz_full_kick_work,
+};
+
+/**
+ * tick_nohz_full_kick_cpu - make a busy tickless cpu reevaluate its tick
+ * @cpu: the cpu that got a second task or a new timer
+ *
+ * Called with interrupts disabled.  A remote cpu is sent a reschedule
+ * IPI, the local one raises an irq_work, so that the check in irq_exit()
+ * runs before we go back to user mode.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu) ||
+	    !ACCESS_ONCE(per_cpu(tick_cpu_sched, cpu).full_stopped))
+		return;
+
+	if (cpu == smp_processor_id())
+		irq_work_queue(&per_cpu(nohz_full_kick_work, cpu));
+	else
+		smp_send_reschedule(cpu);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -578,7 +835,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -673,7 +931,7 @@ static void tick_nohz_kick_tick(int cpu, ktime_t now)
 	if (delta.tv64 <= tick_period.tv64)
 		return;
 
-	tick_nohz_restart(ts, now);
+	tick_nohz_restart(ts, ts->idle_tick, now);
 #endif
 }
 
@@ -733,7 +991,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -758,6 +1017,11 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
+#ifdef CONFIG_NO_HZ_FULL
+		/* The busy tick was stopped: catch up on the missed ticks */
+		if (ts->full_stopped)
+			tick_nohz_full_account(ts, HARDIRQ_OFFSET, 1);
+#endif
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 	}
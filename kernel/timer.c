@@ -727,6 +727,10 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 
+	/* A busy tickless cpu has to rearm its tick for the new timer */
+	if (base == new_base && base->next_timer == timer->expires)
+		tick_nohz_full_kick_cpu(cpu);
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -898,6 +902,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * the timer wheel.
 	 */
 	wake_up_idle_cpu(cpu);
+	tick_nohz_full_kick_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/module.h>
 #include "internal.h"
 
 /*
@@ -30,6 +33,9 @@ struct compact_control {
 	unsigned long nr_migratepages;	/* Number of pages to migrate */
 	unsigned long free_pfn;		/* isolate_freepages search base */
 	unsigned long migrate_pfn;	/* isolate_migratepages search base */
+	unsigned long migrate_budget;	/* Pages kcompactd may scan, 0 = all */
+	unsigned long migrate_limit_pfn;/* Where the budget runs out */
+	unsigned long nr_migrated;	/* Pages successfully migrated */
 
 	/* Account for isolated anon and file pages */
 	unsigned long nr_anon;
@@ -354,6 +360,10 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* Background compaction stops when its scanning budget is used up */
+	if (cc->migrate_limit_pfn && cc->migrate_pfn >= cc->migrate_limit_pfn)
+		return COMPACT_PARTIAL;
+
 	/* Compaction run is not finished if the watermark is not met */
 	if (!zone_watermark_ok(zone, cc->order, watermark, 0, 0))
 		return COMPACT_CONTINUE;
@@ -379,10 +389,17 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
 	int ret;
 
-	/* Setup to move all movable pages to the end of the zone */
-	cc->migrate_pfn = zone->zone_start_pfn;
-	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
+	/*
+	 * Setup to move all movable pages to the end of the zone. kcompactd
+	 * may ask to resume where its previous run left off.
+	 */
+	cc->free_pfn = zone->zone_start_pfn + zone->spanned_pages;
 	cc->free_pfn &= ~(pageblock_nr_pages-1);
+	if (cc->migrate_pfn < zone->zone_start_pfn ||
+	    cc->migrate_pfn >= cc->free_pfn)
+		cc->migrate_pfn = zone->zone_start_pfn;
+	if (cc->migrate_budget)
+		cc->migrate_limit_pfn = cc->migrate_pfn + cc->migrate_budget;
 
 	migrate_prep_local();
 
@@ -400,6 +417,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
+		cc->nr_migrated += nr_migrate - nr_remaining;
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
 
@@ -583,6 +601,188 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * Percentage of a zone's pageblocks kcompactd may scan each time it is
+ * woken. 0 disables background compaction.
+ */
+int sysctl_compaction_proactiveness = 20;
+
+/*
+ * Compact the zones of a node that kswapd could not bring above the low
+ * watermark for the requested order.
+ */
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int zoneid;
+	struct zone *zone;
+
+	pgdat->kcompactd_max_order = 0;
+	if (!order)
+		return;
+
+	count_vm_event(KCOMPACTD_WAKE);
+
+	/* Flush pending updates to the LRU lists */
+	lru_add_drain();
+
+	for (zoneid = 0; zoneid < pgdat->nr_zones; zoneid++) {
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+		};
+		unsigned long watermark, budget;
+		int fragindex;
+		int status;
+
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		if (kthread_should_stop())
+			return;
+
+		watermark = low_wmark_pages(zone);
+		if (zone_watermark_ok(zone, order, watermark, 0, 0))
+			continue;
+
+		if (compaction_deferred(zone))
+			continue;
+
+		/* As in direct compaction, leave room for the migration copies */
+		if (!zone_watermark_ok(zone, 0, watermark + (2UL << order), 0, 0))
+			continue;
+
+		/* Only compact if a failure would be due to fragmentation */
+		fragindex = fragmentation_index(zone, order);
+		if (fragindex >= 0 && fragindex <= sysctl_extfrag_threshold)
+			continue;
+
+		budget = (zone->spanned_pages >> pageblock_order) *
+				sysctl_compaction_proactiveness / 100;
+
+		cc.zone = zone;
+		cc.migrate_pfn = zone->kcompactd_resume_pfn;
+		cc.migrate_budget = max(budget, 1UL) << pageblock_order;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		count_vm_events(KCOMPACTD_PAGES, cc.nr_migrated);
+
+		/* Start over from the zone start once the scanners have met */
+		if (status == COMPACT_COMPLETE)
+			zone->kcompactd_resume_pfn = 0;
+		else
+			zone->kcompactd_resume_pfn = cc.migrate_pfn;
+
+		if (zone_watermark_ok(zone, order, watermark, 0, 0)) {
+			count_vm_event(KCOMPACTD_SUCCESS);
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else {
+			count_vm_event(KCOMPACTD_FAIL);
+			/* The whole zone was scanned, back off for a while */
+			if (status == COMPACT_COMPLETE)
+				defer_compaction(zone);
+		}
+	}
+}
+
+static int kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order || kthread_should_stop();
+}
+
+/*
+ * The background compaction daemon, one per node. It is woken by kswapd
+ * when reclaim alone could not satisfy a high-order watermark, so that
+ * the next high-order allocation does not have to compact directly.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat));
+		kcompactd_do_work(pgdat);
+	}
+
+	return 0;
+}
+
+/*
+ * Called by kswapd when it could not meet the watermarks for an order > 0
+ * allocation on this node.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order)
+{
+	if (!order || !sysctl_compaction_proactiveness)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
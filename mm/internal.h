@@ -15,6 +15,9 @@
 
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
+int handle_pte_fault(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *pte, pmd_t *pmd,
+		unsigned int flags);
 
 static inline void set_page_count(struct page *page, int v)
 {
@@ -45,6 +48,13 @@ extern unsigned long highest_memmap_pfn;
 extern int isolate_lru_page(struct page *page);
 extern void putback_lru_page(struct page *page);
 
+/*
+ * in mm/rmap.c:
+ */
+extern unsigned long vma_address(struct page *page,
+				 struct vm_area_struct *vma);
+extern bool is_vma_temporary_stack(struct vm_area_struct *vma);
+
 /*
  * in mm/page_alloc.c
  */
@@ -34,6 +34,9 @@
 #include <linux/swap.h>
 #include <linux/ksm.h>
 #include <linux/hash.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -55,11 +58,10 @@
  * and therefore this tree is called the stable tree.
  *
  * In addition to the stable tree, KSM uses a second data structure called the
- * unstable tree: this tree holds pointers to pages which have been found to
- * be "unchanged for a period of time".  The unstable tree sorts these pages
- * by their contents, but since they are not write-protected, KSM cannot rely
- * upon the unstable tree to work correctly - the unstable tree is liable to
- * be corrupted as its contents are modified, and so it is called unstable.
+ * unstable tree: this holds pointers to pages which have been found to be
+ * "unchanged for a period of time".  Since these pages are not
+ * write-protected, their contents may change at any moment, and so it is
+ * called unstable.
  *
  * KSM solves this problem by several techniques:
  *
@@ -67,11 +69,9 @@
  *    memory areas, and then the tree is rebuilt again from the beginning.
  * 2) KSM will only insert into the unstable tree, pages whose hash value
  *    has not changed since the previous scan of all memory areas.
- * 3) The unstable tree is a RedBlack Tree - so its balancing is based on the
- *    colors of the nodes and not on their contents, assuring that even when
- *    the tree gets "corrupted" it won't get out of balance, so scanning time
- *    remains the same (also, searching and inserting nodes in an rbtree uses
- *    the same algorithm, so we have no overhead when we flush and rebuild).
+ * 3) Despite its name, the unstable tree is a hash table indexed by that
+ *    hash value, so it cannot be corrupted by pages changing under it, and
+ *    a candidate page is only compared in full when its hash matches.
  * 4) KSM never flushes the stable tree, which means that even if it were to
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
@@ -97,7 +97,7 @@ struct mm_slot {
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @seqnr: count of completed full scans (needed to flush the unstable tree)
  *
  * There is only the one ksm_scan instance of this cursor structure.
  */
@@ -127,7 +127,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
- * @node: rb node of this rmap_item in the unstable tree
+ * @hnode: link into the unstable tree hash chain
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
  */
@@ -138,7 +138,7 @@ struct rmap_item {
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
 	union {
-		struct rb_node node;	/* when node of unstable tree */
+		struct hlist_node hnode; /* when node of unstable tree */
 		struct {		/* when listed from stable tree */
 			struct stable_node *head;
 			struct hlist_node hlist;
@@ -152,7 +152,11 @@ struct rmap_item {
 
 /* The stable and unstable tree heads */
 static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+static struct hlist_head *unstable_hash;
+static unsigned int unstable_hash_shift;
+
+#define UNSTABLE_HASH_MIN_SHIFT	10
+#define UNSTABLE_HASH_MAX_SHIFT	16
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
@@ -187,6 +191,19 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Whether ksmd adapts pages_to_scan to how well pages are merging */
+static unsigned int ksm_scan_governor;
+
+/* Bounds for pages_to_scan when the governor is on */
+static unsigned int ksm_min_pages_to_scan = 100;
+static unsigned int ksm_max_pages_to_scan = 10000;
+
+/* Percentage of a cpu ksmd may use when the governor is on */
+static unsigned int ksm_max_cpu_percent = 20;
+
+/* The number of rmap_items ever added to the stable tree */
+static unsigned long ksm_merges;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -543,18 +560,12 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		rmap_item->address &= PAGE_MASK;
 
 	} else if (rmap_item->address & UNSTABLE_FLAG) {
-		unsigned char age;
 		/*
-		 * Usually ksmd can and must skip the rb_erase, because
-		 * root_unstable_tree was already reset to RB_ROOT.
-		 * But be careful when an mm is exiting: do the rb_erase
-		 * if this rmap_item was inserted by this scan, rather
-		 * than left over from before.
+		 * An rmap_item left over from the previous scan may already
+		 * have been unhashed by unstable_tree_search_insert().
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
-		BUG_ON(age > 1);
-		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+		if (!hlist_unhashed(&rmap_item->hnode))
+			hlist_del_init(&rmap_item->hnode);
 
 		ksm_pages_unshared--;
 		rmap_item->address &= PAGE_MASK;
@@ -783,6 +794,7 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 		goto out;
 
 	pmd = pmd_offset(pud, addr);
+	BUG_ON(pmd_trans_huge(*pmd));
 	if (!pmd_present(*pmd))
 		goto out;
 
@@ -808,6 +820,47 @@ out:
 	return err;
 }
 
+static inline struct page *page_trans_compound_anon(struct page *page)
+{
+	if (PageTransCompound(page)) {
+		struct page *head = compound_trans_head(page);
+		/*
+		 * head may actually be split and freed from under
+		 * us but it's ok here.
+		 */
+		if (PageAnon(head))
+			return head;
+	}
+	return NULL;
+}
+
+static int page_trans_compound_anon_split(struct page *page)
+{
+	int ret = 0;
+	struct page *transhuge_head = page_trans_compound_anon(page);
+	if (transhuge_head) {
+		/* Get the reference on the head to split it. */
+		if (get_page_unless_zero(transhuge_head)) {
+			/*
+			 * Recheck we got the reference while the head
+			 * was still anonymous.
+			 */
+			if (PageAnon(transhuge_head))
+				ret = split_huge_page(transhuge_head);
+			else
+				/*
+				 * Retry later if split_huge_page run
+				 * from under us.
+				 */
+				ret = 1;
+			put_page(transhuge_head);
+		} else
+			/* Retry later if split_huge_page run from under us. */
+			ret = 1;
+	}
+	return ret;
+}
+
 /*
  * try_to_merge_one_page - take two pages and merge them into one
  * @vma: the vma that holds the pte pointing to page
@@ -828,6 +881,9 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 
 	if (!(vma->vm_flags & VM_MERGEABLE))
 		goto out;
+	if (PageTransCompound(page) && page_trans_compound_anon_split(page))
+		goto out;
+	BUG_ON(PageTransCompound(page));
 	if (!PageAnon(page))
 		goto out;
 
@@ -1046,31 +1102,40 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
  * page currently being scanned; and if no identical page is found in the
  * tree, we insert rmap_item as a new object into the unstable tree.
  *
+ * Only the hash chain of the page's checksum is searched, and pages are
+ * only compared in full when their checksums are equal.  rmap_items left
+ * over from the previous full scan are unhashed as they are met: that is
+ * how the unstable tree gets flushed.
+ *
  * This function returns pointer to rmap_item found to be identical
  * to the currently scanned page, NULL otherwise.
- *
- * This function does both searching and inserting, because they share
- * the same walking algorithm in an rbtree.
  */
 static
 struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 					      struct page *page,
+					      unsigned int checksum,
 					      struct page **tree_pagep)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
-	struct rb_node *parent = NULL;
+	struct hlist_head *head;
+	struct hlist_node *pos, *next;
+	struct rmap_item *tree_rmap_item;
 
-	while (*new) {
-		struct rmap_item *tree_rmap_item;
+	head = &unstable_hash[hash_32(checksum, unstable_hash_shift)];
+	hlist_for_each_entry_safe(tree_rmap_item, pos, next, head, hnode) {
 		struct page *tree_page;
-		int ret;
+
+		if ((unsigned char)(ksm_scan.seqnr - tree_rmap_item->address)) {
+			hlist_del_init(&tree_rmap_item->hnode);
+			continue;
+		}
+		if (tree_rmap_item->oldchecksum != checksum)
+			continue;
 
 		cond_resched();
-		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
-			return NULL;
+			continue;
 
 		/*
 		 * Don't substitute a ksm page for a forked page.
@@ -1080,25 +1145,16 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 		}
 
-		ret = memcmp_pages(page, tree_page);
-
-		parent = *new;
-		if (ret < 0) {
-			put_page(tree_page);
-			new = &parent->rb_left;
-		} else if (ret > 0) {
-			put_page(tree_page);
-			new = &parent->rb_right;
-		} else {
+		if (pages_identical(page, tree_page)) {
 			*tree_pagep = tree_page;
 			return tree_rmap_item;
 		}
+		put_page(tree_page);
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
 	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
-	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	hlist_add_head(&rmap_item->hnode, head);
 
 	ksm_pages_unshared++;
 	return NULL;
@@ -1120,6 +1176,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	ksm_merges++;
 }
 
 /*
@@ -1171,8 +1228,8 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		return;
 	}
 
-	tree_rmap_item =
-		unstable_tree_search_insert(rmap_item, page, &tree_page);
+	tree_rmap_item = unstable_tree_search_insert(rmap_item, page,
+						     checksum, &tree_page);
 	if (tree_rmap_item) {
 		kpage = try_to_merge_two_pages(rmap_item, page,
 						tree_rmap_item, tree_page);
@@ -1247,8 +1304,6 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 
 	slot = ksm_scan.mm_slot;
 	if (slot == &ksm_mm_head) {
-		root_unstable_tree = RB_ROOT;
-
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
 		ksm_scan.mm_slot = slot;
@@ -1346,21 +1401,74 @@ next_mm:
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * Returns the number of pages actually scanned.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static unsigned int ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned int scanned;
 
-	while (scan_npages--) {
+	for (scanned = 0; scanned < scan_npages; scanned++) {
 		cond_resched();
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
-			return;
+			break;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
+	return scanned;
+}
+
+/*
+ * The governor doubles pages_to_scan while at least one in
+ * KSM_GOVERNOR_YIELD scanned pages gets merged, and lowers it by a quarter
+ * while nothing merges.  Either way, a batch is kept short enough for its
+ * scan time to stay within max_cpu_percent of the scan time plus the
+ * sleep after it.
+ */
+#define KSM_GOVERNOR_YIELD	64
+
+static void ksm_governor_update(unsigned int scanned, unsigned long merged,
+				u64 scan_ns)
+{
+	u64 pages = ksm_thread_pages_to_scan;
+
+	if (!scanned)
+		return;
+
+	if (merged * KSM_GOVERNOR_YIELD >= scanned)
+		pages *= 2;
+	else if (!merged)
+		pages -= pages / 4;
+
+	if (ksm_max_cpu_percent < 100) {
+		u64 budget_ns, page_ns;
+
+		budget_ns = (u64)ksm_thread_sleep_millisecs * NSEC_PER_MSEC *
+			ksm_max_cpu_percent / (100 - ksm_max_cpu_percent);
+		page_ns = div64_u64(scan_ns, scanned) ? : 1;
+		pages = min(pages, div64_u64(budget_ns, page_ns));
+	}
+
+	pages = min_t(u64, pages, ksm_max_pages_to_scan);
+	pages = max_t(u64, pages, ksm_min_pages_to_scan);
+	ksm_thread_pages_to_scan = pages;
+}
+
+static void ksm_do_scan_batch(void)
+{
+	unsigned long merges = ksm_merges;
+	unsigned int scanned;
+	ktime_t start;
+
+	start = ktime_get();
+	scanned = ksm_do_scan(ksm_thread_pages_to_scan);
+	if (ksm_scan_governor)
+		ksm_governor_update(scanned, ksm_merges - merges,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
 }
 
 static int ksmd_should_run(void)
@@ -1375,7 +1483,7 @@ static int ksm_scan_thread(void *nothing)
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_do_scan_batch();
 		mutex_unlock(&ksm_thread_mutex);
 
 		if (ksmd_should_run()) {
@@ -1804,6 +1912,98 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t scan_governor_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_scan_governor);
+}
+
+static ssize_t scan_governor_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long flags;
+
+	err = strict_strtoul(buf, 10, &flags);
+	if (err || flags > 1)
+		return -EINVAL;
+
+	ksm_scan_governor = flags;
+
+	return count;
+}
+KSM_ATTR(scan_governor);
+
+static ssize_t min_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_min_pages_to_scan);
+}
+
+static ssize_t min_pages_to_scan_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || !nr_pages || nr_pages > ksm_max_pages_to_scan)
+		return -EINVAL;
+
+	ksm_min_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(min_pages_to_scan);
+
+static ssize_t max_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_pages_to_scan);
+}
+
+static ssize_t max_pages_to_scan_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages > UINT_MAX || nr_pages < ksm_min_pages_to_scan)
+		return -EINVAL;
+
+	ksm_max_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(max_pages_to_scan);
+
+static ssize_t max_cpu_percent_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_cpu_percent);
+}
+
+static ssize_t max_cpu_percent_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int err;
+	unsigned long percent;
+
+	err = strict_strtoul(buf, 10, &percent);
+	if (err || !percent || percent > 100)
+		return -EINVAL;
+
+	ksm_max_cpu_percent = percent;
+
+	return count;
+}
+KSM_ATTR(max_cpu_percent);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1899,6 +2099,10 @@ KSM_ATTR_RO(full_scans);
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&scan_governor_attr.attr,
+	&min_pages_to_scan_attr.attr,
+	&max_pages_to_scan_attr.attr,
+	&max_cpu_percent_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
@@ -1923,6 +2127,14 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
+	unstable_hash_shift = clamp_t(int, ilog2(totalram_pages) - 4,
+			UNSTABLE_HASH_MIN_SHIFT, UNSTABLE_HASH_MAX_SHIFT);
+	unstable_hash = vzalloc(sizeof(struct hlist_head) << unstable_hash_shift);
+	if (!unstable_hash) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -1952,6 +2164,7 @@ static int __init ksm_init(void)
 	return 0;
 
 out_free:
+	vfree(unstable_hash);
 	ksm_slab_free();
 out:
 	return err;
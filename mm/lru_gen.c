@@ -0,0 +1,289 @@
+/*
+ * Multi-generational LRU: generation aging by page table walks.
+ *
+ * The LRU lists stay as they are; what this adds is a generation number
+ * in page->flags for every page on them.  Aging opens a new generation by
+ * bumping lru_gen_max_seq, then walks the page tables of the processes
+ * that have run since the previous walk and moves each page mapped by a
+ * young pte into the new generation.  Unmapped page cache is moved there
+ * by mark_page_accessed().  vmscan then asks how many generations old a
+ * page is instead of walking its reverse mappings, and requests another
+ * aging pass when most of the pages it isolates are still young.
+ *
+ * Walking page tables touches each pte once per pass, sequentially and
+ * only for address spaces that were actually in use, whereas the rmap walk
+ * in page_referenced() takes the anon_vma or i_mmap lock and visits every
+ * mapping of every page that reclaim looks at.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/rwsem.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/hugetlb.h>
+#include <linux/mmu_notifier.h>
+#include <linux/vmstat.h>
+#include <linux/init.h>
+#include <linux/workqueue.h>
+#include <linux/lru_gen.h>
+
+#include <asm/pgtable.h>
+
+int lru_gen_mode __read_mostly;
+/* starts high enough that lru_gen_add_page() can place pages behind it */
+unsigned long lru_gen_max_seq = LRU_GEN_MIN_NR_GENS;
+
+/* Every user mm, in the order the aging walks them */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+
+/* Serializes aging passes; the requested flag is set by reclaim */
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+static atomic_t lru_gen_aging_requested = ATOMIC_INIT(0);
+
+struct lru_gen_walk_state {
+	struct vm_area_struct *vma;
+	unsigned long seq;
+	unsigned long nr_young;
+};
+
+static int __init setup_lru_gen(char *str)
+{
+	unsigned long val;
+
+	if (!str || strict_strtoul(str, 10, &val)) {
+		printk(KERN_WARNING "lru_gen= cannot parse, ignored\n");
+		return 0;
+	}
+	lru_gen_mode = !!val;
+	return 1;
+}
+__setup("lru_gen=", setup_lru_gen);
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	INIT_LIST_HEAD(&mm->lru_gen_list);
+	if (!lru_gen_enabled())
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Called from mmput() before exit_mmap().  The aging walk only holds
+ * mm_count, so, as in ksm_exit(), taking mmap_sem for write here waits
+ * out a walk in progress; any later walk sees mm_users at zero and leaves
+ * the page tables alone.
+ */
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	if (list_empty(&mm->lru_gen_list))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+
+	down_write(&mm->mmap_sem);
+	up_write(&mm->mmap_sem);
+}
+
+static int lru_gen_pmd_entry(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk_state *state = walk->private;
+	struct vm_area_struct *vma = state->vma;
+	struct page *page;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+	int young;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	spin_lock(&walk->mm->page_table_lock);
+	if (pmd_trans_huge(*pmd)) {
+		/* a huge pmd being split is picked up by the next pass */
+		if (!pmd_trans_splitting(*pmd) &&
+		    pmdp_clear_flush_young_notify(vma, addr, pmd)) {
+			lru_gen_set_seq(pmd_page(*pmd), state->seq);
+			state->nr_young++;
+		}
+		spin_unlock(&walk->mm->page_table_lock);
+		return 0;
+	}
+	spin_unlock(&walk->mm->page_table_lock);
+#endif
+
+	/*
+	 * mmap_sem is held for read, so khugepaged cannot collapse this
+	 * range into a huge pmd under us.
+	 */
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte))
+			continue;
+		/*
+		 * No TLB flush: a stale young bit in the TLB only means the
+		 * page gets found young again on the next pass.
+		 */
+		young = ptep_test_and_clear_young(vma, addr, pte);
+		young |= mmu_notifier_clear_flush_young(walk->mm, addr);
+		if (!young)
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+		lru_gen_set_seq(page, state->seq);
+		state->nr_young++;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, unsigned long seq)
+{
+	struct lru_gen_walk_state state = {
+		.seq = seq,
+	};
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_pmd_entry,
+		.mm = mm,
+		.private = &state,
+	};
+	struct vm_area_struct *vma;
+
+	if (!down_read_trylock(&mm->mmap_sem)) {
+		/* busy: leave it for the next pass rather than wait in reclaim */
+		set_bit(MMF_LRU_GEN_USED, &mm->flags);
+		return;
+	}
+	if (!atomic_read(&mm->mm_users))
+		goto out;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_IO | VM_PFNMAP | VM_LOCKED))
+			continue;
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		state.vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+
+	count_vm_event(LRU_GEN_MM_WALK);
+	count_vm_events(LRU_GEN_YOUNG, state.nr_young);
+out:
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * The generation number in page->flags comes round again after
+ * LRU_GEN_NR_SEQ passes, and a page untouched for that long would look
+ * young.  Every LRU_GEN_MAX_AGE passes, pull each page older than
+ * LRU_GEN_MAX_AGE back to that age: the pages that have not been
+ * referenced since are then at most 2 * LRU_GEN_MAX_AGE generations
+ * behind when the next pass clamps them.  Generations are stamped
+ * without the lru_lock, so this walks the zones by pfn; a page that is
+ * referenced meanwhile keeps its new generation.
+ *
+ * Walking every struct page is too slow for the reclaimer that happens to
+ * run the aging pass, so it is done from a worker, and no new generation
+ * is opened until it has finished.
+ */
+static void lru_gen_clamp_ages(struct work_struct *work)
+{
+	unsigned long seq = ACCESS_ONCE(lru_gen_max_seq);
+	struct zone *zone;
+	unsigned long pfn, end_pfn;
+
+	for_each_populated_zone(zone) {
+		end_pfn = zone->zone_start_pfn + zone->spanned_pages;
+		for (pfn = zone->zone_start_pfn; pfn < end_pfn; pfn++) {
+			struct page *page;
+			unsigned long old, new;
+
+			if (!(pfn % 1024))
+				cond_resched();
+			if (!pfn_valid(pfn))
+				continue;
+			page = pfn_to_page(pfn);
+
+			do {
+				old = page->flags;
+				if (lru_gen_page_age(page) < LRU_GEN_MAX_AGE)
+					break;
+				new = (old & ~LRU_GEN_MASK) |
+					(lru_gen_from_seq(seq - LRU_GEN_MAX_AGE)
+					 << LRU_GEN_PGOFF);
+			} while (new != old && cmpxchg(&page->flags, old, new) != old);
+		}
+	}
+}
+
+static DECLARE_WORK(lru_gen_clamp_work, lru_gen_clamp_ages);
+
+/*
+ * Open a new generation and walk every mm that ran since the last pass.
+ * A cursor is parked at the tail of the list: each mm is rotated behind
+ * it as it is visited, so the list lock can be dropped for the walk while
+ * mms come and go, and the pass ends when the cursor reaches the head.
+ */
+static void lru_gen_age(void)
+{
+	static struct list_head cursor;
+	struct mm_struct *mm;
+	struct list_head *pos;
+	unsigned long seq;
+
+	seq = lru_gen_max_seq + 1;
+	ACCESS_ONCE(lru_gen_max_seq) = seq;
+	count_vm_event(LRU_GEN_AGING);
+
+	if (!(seq % LRU_GEN_MAX_AGE))
+		schedule_work(&lru_gen_clamp_work);
+
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&cursor, &lru_gen_mm_list);
+	while ((pos = lru_gen_mm_list.next) != &cursor) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		list_move_tail(pos, &lru_gen_mm_list);
+		if (!test_and_clear_bit(MMF_LRU_GEN_USED, &mm->flags))
+			continue;
+		atomic_inc(&mm->mm_count);
+		spin_unlock(&lru_gen_mm_lock);
+
+		lru_gen_walk_mm(mm, seq);
+		mmdrop(mm);
+
+		spin_lock(&lru_gen_mm_lock);
+	}
+	list_del(&cursor);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_request_aging(void)
+{
+	if (!atomic_read(&lru_gen_aging_requested))
+		atomic_set(&lru_gen_aging_requested, 1);
+}
+
+/*
+ * Called from reclaim.  Only one task ages at a time; others carry on
+ * reclaiming against the generations as they stand.
+ */
+void lru_gen_maybe_age(void)
+{
+	if (!atomic_read(&lru_gen_aging_requested))
+		return;
+	if (!mutex_trylock(&lru_gen_aging_mutex))
+		return;
+	/* the request stays pending while the ages are being clamped */
+	if (!work_busy(&lru_gen_clamp_work) &&
+	    atomic_xchg(&lru_gen_aging_requested, 0))
+		lru_gen_age();
+	mutex_unlock(&lru_gen_aging_mutex);
+}
@@ -48,6 +48,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/writeback.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -86,6 +87,9 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_CACHE, 	   /* # of pages charged as cache */
 	MEM_CGROUP_STAT_RSS,	   /* # of pages charged as anon rss */
 	MEM_CGROUP_STAT_FILE_MAPPED,  /* # of pages charged as file rss */
+	MEM_CGROUP_STAT_FILE_DIRTY,	/* # of dirty pages in page cache */
+	MEM_CGROUP_STAT_FILE_WRITEBACK,	/* # of pages under writeback */
+	MEM_CGROUP_STAT_FILE_UNSTABLE_NFS, /* # of NFS unstable pages */
 	MEM_CGROUP_STAT_PGPGIN_COUNT,	/* # of pages paged in */
 	MEM_CGROUP_STAT_PGPGOUT_COUNT,	/* # of pages paged out */
 	MEM_CGROUP_STAT_SWAPOUT, /* # of pages, swapped out */
@@ -185,6 +189,17 @@ struct mem_cgroup_eventfd_list {
 static void mem_cgroup_threshold(struct mem_cgroup *mem);
 static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
 
+/*
+ * Per-memcg copy of the vm.dirty_* sysctls.  Only one of each ratio and
+ * bytes pair is non-zero, the other one is then computed from it.
+ */
+struct vm_dirty_param {
+	int dirty_ratio;
+	int dirty_background_ratio;
+	unsigned long dirty_bytes;
+	unsigned long dirty_background_bytes;
+};
+
 /*
  * The memory controller data structure. The memory controller controls both
  * page cache and RSS per cgroup. We would eventually like to provide
@@ -230,6 +245,8 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	unsigned int	swappiness;
+	/* dirty limits, protected by reclaim_param_lock */
+	struct vm_dirty_param dirty_param;
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -594,22 +611,25 @@ static void mem_cgroup_swap_statistics(struct mem_cgroup *mem,
 
 static void mem_cgroup_charge_statistics(struct mem_cgroup *mem,
 					 struct page_cgroup *pc,
-					 bool charge)
+					 int nr_pages)
 {
-	int val = (charge) ? 1 : -1;
-
 	preempt_disable();
 
 	if (PageCgroupCache(pc))
-		__this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_CACHE], val);
+		__this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_CACHE],
+			       nr_pages);
 	else
-		__this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_RSS], val);
+		__this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_RSS],
+			       nr_pages);
 
-	if (charge)
+	/* pagein of a big page is an event. So, ignore page size */
+	if (nr_pages > 0)
 		__this_cpu_inc(mem->stat->count[MEM_CGROUP_STAT_PGPGIN_COUNT]);
-	else
+	else {
 		__this_cpu_inc(mem->stat->count[MEM_CGROUP_STAT_PGPGOUT_COUNT]);
-	__this_cpu_inc(mem->stat->count[MEM_CGROUP_EVENTS]);
+		nr_pages = -nr_pages; /* for event */
+	}
+	__this_cpu_add(mem->stat->count[MEM_CGROUP_EVENTS], nr_pages);
 
 	preempt_enable();
 }
@@ -808,7 +828,8 @@ void mem_cgroup_del_lru_list(struct page *page, enum lru_list lru)
 	 * removed from global LRU.
 	 */
 	mz = page_cgroup_zoneinfo(pc);
-	MEM_CGROUP_ZSTAT(mz, lru) -= 1;
+	/* huge page split is done under lru_lock. so, we have no races. */
+	MEM_CGROUP_ZSTAT(mz, lru) -= hpage_nr_pages(page);
 	if (mem_cgroup_is_root(pc->mem_cgroup))
 		return;
 	VM_BUG_ON(list_empty(&pc->lru));
@@ -860,7 +881,8 @@ void mem_cgroup_add_lru_list(struct page *page, enum lru_list lru)
 		return;
 
 	mz = page_cgroup_zoneinfo(pc);
-	MEM_CGROUP_ZSTAT(mz, lru) += 1;
+	/* huge page split is done under lru_lock. so, we have no races. */
+	MEM_CGROUP_ZSTAT(mz, lru) += hpage_nr_pages(page);
 	SetPageCgroupAcctLRU(pc);
 	if (mem_cgroup_is_root(pc->mem_cgroup))
 		return;
@@ -1113,6 +1135,20 @@ static bool mem_cgroup_check_under_limit(struct mem_cgroup *mem)
 	return false;
 }
 
+/*
+ * Return the number of bytes that can still be charged to @mem
+ * without hitting its limit.
+ */
+static unsigned long long mem_cgroup_margin(struct mem_cgroup *mem)
+{
+	unsigned long long margin;
+
+	margin = res_counter_margin(&mem->res);
+	if (do_swap_account)
+		margin = min(margin, res_counter_margin(&mem->memsw));
+	return margin;
+}
+
 static unsigned int get_swappiness(struct mem_cgroup *memcg)
 {
 	struct cgroup *cgrp = memcg->css.cgroup;
@@ -1607,16 +1643,27 @@ static void mem_cgroup_update_file_stat(struct page *page, int idx, int val)
 		goto out;
 	/* pc->mem_cgroup is unstable ? */
 	if (unlikely(mem_cgroup_stealed(mem))) {
-		/* take a lock against to access pc->mem_cgroup */
-		lock_page_cgroup(pc);
+		/*
+		 * take a lock against to access pc->mem_cgroup.  Writeback
+		 * completes in interrupt context, where the lock may be held
+		 * by the task we interrupted: skip the update then, the flag
+		 * stays set and the next clear of it catches up.
+		 */
+		if (!in_interrupt())
+			lock_page_cgroup(pc);
+		else if (!trylock_page_cgroup(pc))
+			goto out;
 		need_unlock = true;
 		mem = pc->mem_cgroup;
 		if (!mem || !PageCgroupUsed(pc))
 			goto out;
 	}
 
-	this_cpu_add(mem->stat->count[idx], val);
-
+	/*
+	 * The dirty, writeback and unstable states are counted once per
+	 * page, whatever the callers do: the page_cgroup flag records
+	 * whether the page is currently counted.
+	 */
 	switch (idx) {
 	case MEM_CGROUP_STAT_FILE_MAPPED:
 		if (val > 0)
@@ -1624,10 +1671,26 @@ static void mem_cgroup_update_file_stat(struct page *page, int idx, int val)
 		else if (!page_mapped(page))
 			ClearPageCgroupFileMapped(pc);
 		break;
+	case MEM_CGROUP_STAT_FILE_DIRTY:
+		if (val > 0 ? TestSetPageCgroupFileDirty(pc) :
+			      !TestClearPageCgroupFileDirty(pc))
+			goto out;
+		break;
+	case MEM_CGROUP_STAT_FILE_WRITEBACK:
+		if (val > 0 ? TestSetPageCgroupFileWriteback(pc) :
+			      !TestClearPageCgroupFileWriteback(pc))
+			goto out;
+		break;
+	case MEM_CGROUP_STAT_FILE_UNSTABLE_NFS:
+		if (val > 0 ? TestSetPageCgroupFileUnstableNFS(pc) :
+			      !TestClearPageCgroupFileUnstableNFS(pc))
+			goto out;
+		break;
 	default:
 		BUG();
 	}
 
+	this_cpu_add(mem->stat->count[idx], val);
 out:
 	if (unlikely(need_unlock))
 		unlock_page_cgroup(pc);
@@ -1640,11 +1703,69 @@ void mem_cgroup_update_file_mapped(struct page *page, int val)
 	mem_cgroup_update_file_stat(page, MEM_CGROUP_STAT_FILE_MAPPED, val);
 }
 
+void mem_cgroup_update_page_stat(struct page *page,
+				 enum mem_cgroup_page_stat_item item, int val)
+{
+	int idx;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	switch (item) {
+	case MEMCG_NR_FILE_DIRTY:
+		idx = MEM_CGROUP_STAT_FILE_DIRTY;
+		break;
+	case MEMCG_NR_FILE_WRITEBACK:
+		idx = MEM_CGROUP_STAT_FILE_WRITEBACK;
+		break;
+	case MEMCG_NR_FILE_UNSTABLE_NFS:
+		idx = MEM_CGROUP_STAT_FILE_UNSTABLE_NFS;
+		break;
+	default:
+		BUG();
+	}
+	mem_cgroup_update_file_stat(page, idx, val);
+}
+
+static void mem_cgroup_move_file_stat(struct mem_cgroup *from,
+				      struct mem_cgroup *to, int idx)
+{
+	preempt_disable();
+	__this_cpu_dec(from->stat->count[idx]);
+	__this_cpu_inc(to->stat->count[idx]);
+	preempt_enable();
+}
+
+/*
+ * Drop the page cache states still counted for a page which is being
+ * uncharged, so that they are neither leaked in @mem nor carried over to
+ * the next user of the page_cgroup.
+ */
+static void mem_cgroup_drop_file_stat(struct mem_cgroup *mem,
+				      struct page_cgroup *pc)
+{
+	preempt_disable();
+	if (TestClearPageCgroupFileDirty(pc))
+		__this_cpu_dec(mem->stat->count[MEM_CGROUP_STAT_FILE_DIRTY]);
+	if (TestClearPageCgroupFileWriteback(pc))
+		__this_cpu_dec(mem->stat->count[MEM_CGROUP_STAT_FILE_WRITEBACK]);
+	if (TestClearPageCgroupFileUnstableNFS(pc))
+		__this_cpu_dec(
+			mem->stat->count[MEM_CGROUP_STAT_FILE_UNSTABLE_NFS]);
+	preempt_enable();
+}
+
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
  * TODO: maybe necessary to use big numbers in big irons.
  */
 #define CHARGE_SIZE	(32 * PAGE_SIZE)
+/*
+ * Uncharges are returned to the local stock rather than to res_counter
+ * while it holds less than this, so that the next charges on this cpu
+ * don't have to go back to res_counter for them.
+ */
+#define STOCK_MAX	(4 * CHARGE_SIZE)
 struct memcg_stock_pcp {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	int charge;
@@ -1715,6 +1836,28 @@ static void refill_stock(struct mem_cgroup *mem, int val)
 	put_cpu_var(memcg_stock);
 }
 
+/*
+ * Try to keep an uncharge of val bytes from both res and memsw in the
+ * local stock, when it already caches mem or caches nothing.  Returns the
+ * number of bytes which still have to be uncharged from res_counter.
+ */
+static unsigned long uncharge_to_stock(struct mem_cgroup *mem,
+				       unsigned long val)
+{
+	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	unsigned long room;
+
+	if (!stock->cached)
+		stock->cached = mem;
+	if (stock->cached == mem && stock->charge < STOCK_MAX) {
+		room = min_t(unsigned long, STOCK_MAX - stock->charge, val);
+		stock->charge += room;
+		val -= room;
+	}
+	put_cpu_var(memcg_stock);
+	return val;
+}
+
 /*
  * Tries to drain stocked charges in other cpus. This function is asynchronous
  * and just put a work per cpu for draining localy on each cpu. Caller can
@@ -1737,6 +1880,9 @@ static void drain_all_stock_async(void)
 	get_online_cpus();
 	for_each_online_cpu(cpu) {
 		struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
+		/* racy, but an idle stock needs no drain anyway */
+		if (!stock->charge)
+			continue;
 		schedule_work_on(cpu, &stock->work);
 	}
  	put_online_cpus();
@@ -1796,7 +1942,7 @@ static int __cpuinit memcg_cpu_hotplug_callback(struct notifier_block *nb,
 		return NOTIFY_OK;
 	}
 
-	if ((action != CPU_DEAD) || action != CPU_DEAD_FROZEN)
+	if ((action != CPU_DEAD) && action != CPU_DEAD_FROZEN)
 		return NOTIFY_OK;
 
 	for_each_mem_cgroup_all(iter)
@@ -1839,7 +1985,13 @@ static int __mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 	} else
 		mem_over_limit = mem_cgroup_from_res_counter(fail_res, res);
 
-	if (csize > PAGE_SIZE) /* change csize and retry */
+	/*
+	 * csize can be either a huge page (HPAGE_SIZE), a batch of
+	 * regular pages (CHARGE_SIZE), or a single regular page
+	 * (PAGE_SIZE).  Never reclaim on behalf of optional batching,
+	 * retry with a single page instead.
+	 */
+	if (csize == CHARGE_SIZE)
 		return CHARGE_RETRY;
 
 	if (!(gfp_mask & __GFP_WAIT))
@@ -1854,7 +2006,15 @@ static int __mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 	 * Check the limit again to see if the reclaim reduced the
 	 * current usage of the cgroup before giving up
 	 */
-	if (ret || mem_cgroup_check_under_limit(mem_over_limit))
+	if (csize > CHARGE_SIZE) {
+		/*
+		 * A huge page only fits if reclaim made room for all of
+		 * it; the fault handler falls back to regular pages
+		 * otherwise, so don't keep reclaiming on its behalf.
+		 */
+		if (mem_cgroup_margin(mem_over_limit) >= csize)
+			return CHARGE_RETRY;
+	} else if (ret || mem_cgroup_check_under_limit(mem_over_limit))
 		return CHARGE_RETRY;
 
 	/*
@@ -1879,12 +2039,14 @@ static int __mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
  * oom-killer can be invoked.
  */
 static int __mem_cgroup_try_charge(struct mm_struct *mm,
-		gfp_t gfp_mask, struct mem_cgroup **memcg, bool oom)
+				   gfp_t gfp_mask,
+				   struct mem_cgroup **memcg, bool oom,
+				   int page_size)
 {
 	int nr_oom_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct mem_cgroup *mem = NULL;
 	int ret;
-	int csize = CHARGE_SIZE;
+	int csize = max_t(int, CHARGE_SIZE, page_size);
 
 	/*
 	 * Unlike gloval-vm's OOM-kill, we're not in memory shortage
@@ -1909,7 +2071,7 @@ again:
 		VM_BUG_ON(css_is_removed(&mem->css));
 		if (mem_cgroup_is_root(mem))
 			goto done;
-		if (consume_stock(mem))
+		if (page_size == PAGE_SIZE && consume_stock(mem))
 			goto done;
 		css_get(&mem->css);
 	} else {
@@ -1933,7 +2095,7 @@ again:
 			rcu_read_unlock();
 			goto done;
 		}
-		if (consume_stock(mem)) {
+		if (page_size == PAGE_SIZE && consume_stock(mem)) {
 			/*
 			 * It seems dagerous to access memcg without css_get().
 			 * But considering how consume_stok works, it's not
@@ -1974,7 +2136,7 @@ again:
 		case CHARGE_OK:
 			break;
 		case CHARGE_RETRY: /* not in OOM situation but retry */
-			csize = PAGE_SIZE;
+			csize = page_size;
 			css_put(&mem->css);
 			mem = NULL;
 			goto again;
@@ -1995,8 +2157,8 @@ again:
 		}
 	} while (ret != CHARGE_OK);
 
-	if (csize > PAGE_SIZE)
-		refill_stock(mem, csize - PAGE_SIZE);
+	if (csize > page_size)
+		refill_stock(mem, csize - page_size);
 	css_put(&mem->css);
 done:
 	*memcg = mem;
@@ -2024,9 +2186,10 @@ static void __mem_cgroup_cancel_charge(struct mem_cgroup *mem,
 	}
 }
 
-static void mem_cgroup_cancel_charge(struct mem_cgroup *mem)
+static void mem_cgroup_cancel_charge(struct mem_cgroup *mem,
+				     int page_size)
 {
-	__mem_cgroup_cancel_charge(mem, 1);
+	__mem_cgroup_cancel_charge(mem, page_size >> PAGE_SHIFT);
 }
 
 /*
@@ -2082,9 +2245,12 @@ struct mem_cgroup *try_get_mem_cgroup_from_page(struct page *page)
  */
 
 static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
-				     struct page_cgroup *pc,
-				     enum charge_type ctype)
+				       struct page_cgroup *pc,
+				       enum charge_type ctype,
+				       int page_size)
 {
+	int nr_pages = page_size >> PAGE_SHIFT;
+
 	/* try_charge() can return NULL to *memcg, taking care of it. */
 	if (!mem)
 		return;
@@ -2092,7 +2258,7 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
 	lock_page_cgroup(pc);
 	if (unlikely(PageCgroupUsed(pc))) {
 		unlock_page_cgroup(pc);
-		mem_cgroup_cancel_charge(mem);
+		mem_cgroup_cancel_charge(mem, page_size);
 		return;
 	}
 
@@ -2119,7 +2285,7 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
 		break;
 	}
 
-	mem_cgroup_charge_statistics(mem, pc, true);
+	mem_cgroup_charge_statistics(mem, pc, nr_pages);
 
 	unlock_page_cgroup(pc);
 	/*
@@ -2130,6 +2296,47 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
 	memcg_check_events(mem, pc->page);
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+
+#define PCGF_NOCOPY_AT_SPLIT ((1 << PCG_LOCK) | (1 << PCG_ACCT_LRU) |\
+			(1 << PCG_MIGRATION))
+/*
+ * Because tail pages are not marked as "used", set it. We're under
+ * zone->lru_lock, 'splitting on pmd' and compound_lock.
+ */
+void mem_cgroup_split_huge_fixup(struct page *head, struct page *tail)
+{
+	struct page_cgroup *head_pc = lookup_page_cgroup(head);
+	struct page_cgroup *tail_pc = lookup_page_cgroup(tail);
+
+	if (mem_cgroup_disabled())
+		return;
+	/*
+	 * We have no races with charge/uncharge but will have races with
+	 * page state accounting.
+	 */
+	lock_page_cgroup(head_pc);
+
+	tail_pc->mem_cgroup = head_pc->mem_cgroup;
+	smp_wmb(); /* see __commit_charge() */
+	if (PageCgroupAcctLRU(head_pc)) {
+		enum lru_list lru;
+		struct mem_cgroup_per_zone *mz;
+
+		/*
+		 * LRU flags cannot be copied because we need to add tail
+		 * page to LRU by generic call and our hook will be called.
+		 * We hold lru_lock, then, reduce counter directly.
+		 */
+		lru = page_lru(head);
+		mz = page_cgroup_zoneinfo(head_pc);
+		MEM_CGROUP_ZSTAT(mz, lru) -= 1;
+	}
+	tail_pc->flags = head_pc->flags & ~PCGF_NOCOPY_AT_SPLIT;
+	unlock_page_cgroup(head_pc);
+}
+#endif
+
 /**
  * __mem_cgroup_move_account - move account of the page
  * @pc:	page_cgroup of the page.
@@ -2148,8 +2355,11 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
  */
 
 static void __mem_cgroup_move_account(struct page_cgroup *pc,
-	struct mem_cgroup *from, struct mem_cgroup *to, bool uncharge)
+	struct mem_cgroup *from, struct mem_cgroup *to, bool uncharge,
+	int charge_size)
 {
+	int nr_pages = charge_size >> PAGE_SHIFT;
+
 	VM_BUG_ON(from == to);
 	VM_BUG_ON(PageLRU(pc->page));
 	VM_BUG_ON(!PageCgroupLocked(pc));
@@ -2163,14 +2373,22 @@ static void __mem_cgroup_move_account(struct page_cgroup *pc,
 		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
 		preempt_enable();
 	}
-	mem_cgroup_charge_statistics(from, pc, false);
+	if (PageCgroupFileDirty(pc))
+		mem_cgroup_move_file_stat(from, to, MEM_CGROUP_STAT_FILE_DIRTY);
+	if (PageCgroupFileWriteback(pc))
+		mem_cgroup_move_file_stat(from, to,
+					  MEM_CGROUP_STAT_FILE_WRITEBACK);
+	if (PageCgroupFileUnstableNFS(pc))
+		mem_cgroup_move_file_stat(from, to,
+					  MEM_CGROUP_STAT_FILE_UNSTABLE_NFS);
+	mem_cgroup_charge_statistics(from, pc, -nr_pages);
 	if (uncharge)
 		/* This is not "cancel", but cancel_charge does all we need. */
-		mem_cgroup_cancel_charge(from);
+		mem_cgroup_cancel_charge(from, charge_size);
 
 	/* caller should have done css_get */
 	pc->mem_cgroup = to;
-	mem_cgroup_charge_statistics(to, pc, true);
+	mem_cgroup_charge_statistics(to, pc, nr_pages);
 	/*
 	 * We charges against "to" which may not have any tasks. Then, "to"
 	 * can be under rmdir(). But in current implementation, caller of
@@ -2185,12 +2403,18 @@ static void __mem_cgroup_move_account(struct page_cgroup *pc,
  * __mem_cgroup_move_account()
  */
 static int mem_cgroup_move_account(struct page_cgroup *pc,
-		struct mem_cgroup *from, struct mem_cgroup *to, bool uncharge)
+		struct mem_cgroup *from, struct mem_cgroup *to,
+		bool uncharge, int charge_size)
 {
 	int ret = -EINVAL;
+
+	/* a huge page may have been split since the caller sized it */
+	if ((charge_size > PAGE_SIZE) && !PageTransHuge(pc->page))
+		goto out;
+
 	lock_page_cgroup(pc);
 	if (PageCgroupUsed(pc) && pc->mem_cgroup == from) {
-		__mem_cgroup_move_account(pc, from, to, uncharge);
+		__mem_cgroup_move_account(pc, from, to, uncharge, charge_size);
 		ret = 0;
 	}
 	unlock_page_cgroup(pc);
@@ -2199,6 +2423,7 @@ static int mem_cgroup_move_account(struct page_cgroup *pc,
 	 */
 	memcg_check_events(to, pc->page);
 	memcg_check_events(from, pc->page);
+out:
 	return ret;
 }
 
@@ -2214,6 +2439,8 @@ static int mem_cgroup_move_parent(struct page_cgroup *pc,
 	struct cgroup *cg = child->css.cgroup;
 	struct cgroup *pcg = cg->parent;
 	struct mem_cgroup *parent;
+	int page_size = PAGE_SIZE;
+	unsigned long flags;
 	int ret;
 
 	/* Is ROOT ? */
@@ -2226,14 +2453,25 @@ static int mem_cgroup_move_parent(struct page_cgroup *pc,
 	if (isolate_lru_page(page))
 		goto put;
 
+	if (PageTransHuge(page))
+		page_size = HPAGE_SIZE;
+
 	parent = mem_cgroup_from_cont(pcg);
-	ret = __mem_cgroup_try_charge(NULL, gfp_mask, &parent, false);
+	ret = __mem_cgroup_try_charge(NULL, gfp_mask,
+				      &parent, false, page_size);
 	if (ret || !parent)
 		goto put_back;
 
-	ret = mem_cgroup_move_account(pc, child, parent, true);
+	/* keep split_huge_page() away while the charge moves */
+	if (page_size > PAGE_SIZE)
+		flags = compound_lock_irqsave(page);
+
+	ret = mem_cgroup_move_account(pc, child, parent, true, page_size);
 	if (ret)
-		mem_cgroup_cancel_charge(parent);
+		mem_cgroup_cancel_charge(parent, page_size);
+
+	if (page_size > PAGE_SIZE)
+		compound_unlock_irqrestore(page, flags);
 put_back:
 	putback_lru_page(page);
 put:
@@ -2253,19 +2491,30 @@ static int mem_cgroup_charge_common(struct page *page, struct mm_struct *mm,
 {
 	struct mem_cgroup *mem = NULL;
 	struct page_cgroup *pc;
+	int page_size = PAGE_SIZE;
+	bool oom = true;
 	int ret;
 
+	if (PageTransHuge(page)) {
+		page_size <<= compound_order(page);
+		/*
+		 * Never OOM-kill a process for a huge page.  The
+		 * fault handler will fall back to regular pages.
+		 */
+		oom = false;
+	}
+
 	pc = lookup_page_cgroup(page);
 	/* can happen at boot */
 	if (unlikely(!pc))
 		return 0;
 	prefetchw(pc);
 
-	ret = __mem_cgroup_try_charge(mm, gfp_mask, &mem, true);
+	ret = __mem_cgroup_try_charge(mm, gfp_mask, &mem, oom, page_size);
 	if (ret || !mem)
 		return ret;
 
-	__mem_cgroup_commit_charge(mem, pc, ctype);
+	__mem_cgroup_commit_charge(mem, pc, ctype, page_size);
 	return 0;
 }
 
@@ -2274,8 +2523,6 @@ int mem_cgroup_newpage_charge(struct page *page,
 {
 	if (mem_cgroup_disabled())
 		return 0;
-	if (PageCompound(page))
-		return 0;
 	/*
 	 * If already mapped, we don't have to account.
 	 * If page cache, page->mapping has address_space.
@@ -2381,13 +2628,13 @@ int mem_cgroup_try_charge_swapin(struct mm_struct *mm,
 	if (!mem)
 		goto charge_cur_mm;
 	*ptr = mem;
-	ret = __mem_cgroup_try_charge(NULL, mask, ptr, true);
+	ret = __mem_cgroup_try_charge(NULL, mask, ptr, true, PAGE_SIZE);
 	css_put(&mem->css);
 	return ret;
 charge_cur_mm:
 	if (unlikely(!mm))
 		mm = &init_mm;
-	return __mem_cgroup_try_charge(mm, mask, ptr, true);
+	return __mem_cgroup_try_charge(mm, mask, ptr, true, PAGE_SIZE);
 }
 
 static void
@@ -2403,7 +2650,7 @@ __mem_cgroup_commit_charge_swapin(struct page *page, struct mem_cgroup *ptr,
 	cgroup_exclude_rmdir(&ptr->css);
 	pc = lookup_page_cgroup(page);
 	mem_cgroup_lru_del_before_commit_swapcache(page);
-	__mem_cgroup_commit_charge(ptr, pc, ctype);
+	__mem_cgroup_commit_charge(ptr, pc, ctype, PAGE_SIZE);
 	mem_cgroup_lru_add_after_commit_swapcache(page);
 	/*
 	 * Now swap is on-memory. This means this page may be
@@ -2452,11 +2699,12 @@ void mem_cgroup_cancel_charge_swapin(struct mem_cgroup *mem)
 		return;
 	if (!mem)
 		return;
-	mem_cgroup_cancel_charge(mem);
+	mem_cgroup_cancel_charge(mem, PAGE_SIZE);
 }
 
 static void
-__do_uncharge(struct mem_cgroup *mem, const enum charge_type ctype)
+__do_uncharge(struct mem_cgroup *mem, const enum charge_type ctype,
+	      int page_size)
 {
 	struct memcg_batch_info *batch = NULL;
 	bool uncharge_memsw = true;
@@ -2483,6 +2731,10 @@ __do_uncharge(struct mem_cgroup *mem, const enum charge_type ctype)
 	if (!batch->do_batch || test_thread_flag(TIF_MEMDIE))
 		goto direct_uncharge;
 
+	/* huge pages are uncharged in one go, the batch is for small ones */
+	if (page_size != PAGE_SIZE)
+		goto direct_uncharge;
+
 	/*
 	 * In typical case, batch->memcg == mem. This means we can
 	 * merge a series of uncharges to an uncharge of res_counter.
@@ -2496,9 +2748,16 @@ __do_uncharge(struct mem_cgroup *mem, const enum charge_type ctype)
 		batch->memsw_bytes += PAGE_SIZE;
 	return;
 direct_uncharge:
-	res_counter_uncharge(&mem->res, PAGE_SIZE);
+	/*
+	 * A single page is kept in the local stock, unless we are being
+	 * OOM killed or the memsw charge has to stay.
+	 */
+	if (page_size == PAGE_SIZE && (uncharge_memsw || !do_swap_account) &&
+	    !test_thread_flag(TIF_MEMDIE) && !uncharge_to_stock(mem, PAGE_SIZE))
+		return;
+	res_counter_uncharge(&mem->res, page_size);
 	if (uncharge_memsw)
-		res_counter_uncharge(&mem->memsw, PAGE_SIZE);
+		res_counter_uncharge(&mem->memsw, page_size);
 	if (unlikely(batch->memcg != mem))
 		memcg_oom_recover(mem);
 	return;
@@ -2512,6 +2771,7 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 {
 	struct page_cgroup *pc;
 	struct mem_cgroup *mem = NULL;
+	int page_size = PAGE_SIZE;
 
 	if (mem_cgroup_disabled())
 		return NULL;
@@ -2519,6 +2779,9 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 	if (PageSwapCache(page))
 		return NULL;
 
+	if (PageTransHuge(page))
+		page_size <<= compound_order(page);
+
 	/*
 	 * Check if our page_cgroup is valid
 	 */
@@ -2551,7 +2814,8 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 		break;
 	}
 
-	mem_cgroup_charge_statistics(mem, pc, false);
+	mem_cgroup_charge_statistics(mem, pc, -(page_size >> PAGE_SHIFT));
+	mem_cgroup_drop_file_stat(mem, pc);
 
 	ClearPageCgroupUsed(pc);
 	/*
@@ -2572,7 +2836,7 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 		mem_cgroup_get(mem);
 	}
 	if (!mem_cgroup_is_root(mem))
-		__do_uncharge(mem, ctype);
+		__do_uncharge(mem, ctype, page_size);
 
 	return mem;
 
@@ -2633,7 +2897,20 @@ void mem_cgroup_uncharge_end(void)
 	/*
 	 * This "batch->memcg" is valid without any css_get/put etc...
 	 * bacause we hide charges behind us.
+	 *
+	 * As much of the batch as was uncharged from both res and memsw
+	 * goes into the local stock first.
 	 */
+	if (!test_thread_flag(TIF_MEMDIE) &&
+	    (batch->memsw_bytes == batch->bytes || !do_swap_account)) {
+		unsigned long left;
+
+		left = uncharge_to_stock(batch->memcg, batch->bytes);
+
+		if (do_swap_account)
+			batch->memsw_bytes = left;
+		batch->bytes = left;
+	}
 	if (batch->bytes)
 		res_counter_uncharge(&batch->memcg->res, batch->bytes);
 	if (batch->memsw_bytes)
@@ -2816,7 +3093,7 @@ int mem_cgroup_prepare_migration(struct page *page,
 		return 0;
 
 	*ptr = mem;
-	ret = __mem_cgroup_try_charge(NULL, GFP_KERNEL, ptr, false);
+	ret = __mem_cgroup_try_charge(NULL, GFP_KERNEL, ptr, false, PAGE_SIZE);
 	css_put(&mem->css);/* drop extra refcnt */
 	if (ret || *ptr == NULL) {
 		if (PageAnon(page)) {
@@ -2843,7 +3120,7 @@ int mem_cgroup_prepare_migration(struct page *page,
 		ctype = MEM_CGROUP_CHARGE_TYPE_CACHE;
 	else
 		ctype = MEM_CGROUP_CHARGE_TYPE_SHMEM;
-	__mem_cgroup_commit_charge(mem, pc, ctype);
+	__mem_cgroup_commit_charge(mem, pc, ctype, PAGE_SIZE);
 	return ret;
 }
 
@@ -3534,6 +3811,9 @@ enum {
 	MCS_CACHE,
 	MCS_RSS,
 	MCS_FILE_MAPPED,
+	MCS_FILE_DIRTY,
+	MCS_WRITEBACK,
+	MCS_UNSTABLE_NFS,
 	MCS_PGPGIN,
 	MCS_PGPGOUT,
 	MCS_SWAP,
@@ -3556,6 +3836,9 @@ struct {
 	{"cache", "total_cache"},
 	{"rss", "total_rss"},
 	{"mapped_file", "total_mapped_file"},
+	{"dirty", "total_dirty"},
+	{"writeback", "total_writeback"},
+	{"nfs_unstable", "total_nfs_unstable"},
 	{"pgpgin", "total_pgpgin"},
 	{"pgpgout", "total_pgpgout"},
 	{"swap", "total_swap"},
@@ -3579,6 +3862,12 @@ mem_cgroup_get_local_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
 	s->stat[MCS_RSS] += val * PAGE_SIZE;
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_MAPPED);
 	s->stat[MCS_FILE_MAPPED] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_DIRTY);
+	s->stat[MCS_FILE_DIRTY] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_WRITEBACK);
+	s->stat[MCS_WRITEBACK] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_UNSTABLE_NFS);
+	s->stat[MCS_UNSTABLE_NFS] += val * PAGE_SIZE;
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_PGPGIN_COUNT);
 	s->stat[MCS_PGPGIN] += val;
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_PGPGOUT_COUNT);
@@ -3714,6 +4003,224 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+/* The root cgroup follows the vm.dirty_* sysctls */
+static void get_dirty_param(struct mem_cgroup *memcg,
+			    struct vm_dirty_param *param)
+{
+	if (memcg->css.cgroup->parent == NULL) {
+		param->dirty_ratio = vm_dirty_ratio;
+		param->dirty_bytes = vm_dirty_bytes;
+		param->dirty_background_ratio = dirty_background_ratio;
+		param->dirty_background_bytes = dirty_background_bytes;
+		return;
+	}
+
+	spin_lock(&memcg->reclaim_param_lock);
+	*param = memcg->dirty_param;
+	spin_unlock(&memcg->reclaim_param_lock);
+}
+
+enum {
+	MEM_CGROUP_DIRTY_RATIO,
+	MEM_CGROUP_DIRTY_LIMIT_IN_BYTES,
+	MEM_CGROUP_DIRTY_BACKGROUND_RATIO,
+	MEM_CGROUP_DIRTY_BACKGROUND_LIMIT_IN_BYTES,
+};
+
+static u64 mem_cgroup_dirty_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	struct vm_dirty_param param;
+
+	get_dirty_param(memcg, &param);
+
+	switch (cft->private) {
+	case MEM_CGROUP_DIRTY_RATIO:
+		return param.dirty_ratio;
+	case MEM_CGROUP_DIRTY_LIMIT_IN_BYTES:
+		return param.dirty_bytes;
+	case MEM_CGROUP_DIRTY_BACKGROUND_RATIO:
+		return param.dirty_background_ratio;
+	case MEM_CGROUP_DIRTY_BACKGROUND_LIMIT_IN_BYTES:
+		return param.dirty_background_bytes;
+	default:
+		BUG();
+	}
+}
+
+/*
+ * Like the sysctls, setting a ratio clears the matching limit in bytes
+ * and the other way round.
+ */
+static int mem_cgroup_dirty_write(struct cgroup *cgrp, struct cftype *cft,
+				  const char *buffer)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	struct vm_dirty_param *param = &memcg->dirty_param;
+	unsigned long long val;
+	char *end;
+	int ret = 0;
+
+	if (cgrp->parent == NULL)
+		return -EINVAL;
+
+	switch (cft->private) {
+	case MEM_CGROUP_DIRTY_RATIO:
+	case MEM_CGROUP_DIRTY_BACKGROUND_RATIO:
+		ret = strict_strtoull(buffer, 10, &val);
+		if (ret || val > 100)
+			return -EINVAL;
+		break;
+	default:
+		val = memparse(buffer, &end);
+		if (*end != '\0')
+			return -EINVAL;
+		break;
+	}
+
+	spin_lock(&memcg->reclaim_param_lock);
+	switch (cft->private) {
+	case MEM_CGROUP_DIRTY_RATIO:
+		param->dirty_ratio = val;
+		param->dirty_bytes = 0;
+		break;
+	case MEM_CGROUP_DIRTY_LIMIT_IN_BYTES:
+		if (val < 2 * PAGE_SIZE) {
+			ret = -EINVAL;
+			break;
+		}
+		param->dirty_bytes = val;
+		param->dirty_ratio = 0;
+		break;
+	case MEM_CGROUP_DIRTY_BACKGROUND_RATIO:
+		param->dirty_background_ratio = val;
+		param->dirty_background_bytes = 0;
+		break;
+	case MEM_CGROUP_DIRTY_BACKGROUND_LIMIT_IN_BYTES:
+		if (!val) {
+			ret = -EINVAL;
+			break;
+		}
+		param->dirty_background_bytes = val;
+		param->dirty_background_ratio = 0;
+		break;
+	default:
+		BUG();
+	}
+	spin_unlock(&memcg->reclaim_param_lock);
+
+	return ret;
+}
+
+/*
+ * The memory that @mem can still fill with dirty pages: what it can charge
+ * before hitting its limit, plus the page cache it could reclaim.
+ */
+static unsigned long mem_cgroup_dirtyable_pages(struct mem_cgroup *mem,
+						unsigned long sys_available_mem)
+{
+	struct mem_cgroup *iter;
+	u64 pages;
+
+	pages = mem_cgroup_margin(mem) >> PAGE_SHIFT;
+	for_each_mem_cgroup_tree(iter, mem) {
+		pages += mem_cgroup_get_local_zonestat(iter, LRU_INACTIVE_FILE);
+		pages += mem_cgroup_get_local_zonestat(iter, LRU_ACTIVE_FILE);
+	}
+
+	return min_t(u64, pages, sys_available_mem);
+}
+
+static void __mem_cgroup_dirty_info(struct mem_cgroup *mem,
+				    unsigned long sys_available_mem,
+				    struct mem_cgroup_dirty_info *info)
+{
+	struct vm_dirty_param param;
+	unsigned long available;
+
+	get_dirty_param(mem, &param);
+	available = mem_cgroup_dirtyable_pages(mem, sys_available_mem);
+
+	if (param.dirty_bytes)
+		info->dirty_thresh = DIV_ROUND_UP(param.dirty_bytes, PAGE_SIZE);
+	else
+		info->dirty_thresh = (param.dirty_ratio * available) / 100;
+
+	if (param.dirty_background_bytes)
+		info->background_thresh =
+			DIV_ROUND_UP(param.dirty_background_bytes, PAGE_SIZE);
+	else
+		info->background_thresh =
+			(param.dirty_background_ratio * available) / 100;
+
+	if (info->background_thresh >= info->dirty_thresh)
+		info->background_thresh = info->dirty_thresh / 2;
+
+	info->nr_file_dirty = mem_cgroup_get_recursive_idx_stat(mem,
+					MEM_CGROUP_STAT_FILE_DIRTY);
+	info->nr_writeback = mem_cgroup_get_recursive_idx_stat(mem,
+					MEM_CGROUP_STAT_FILE_WRITEBACK);
+	info->nr_unstable_nfs = mem_cgroup_get_recursive_idx_stat(mem,
+					MEM_CGROUP_STAT_FILE_UNSTABLE_NFS);
+}
+
+/**
+ * mem_cgroup_dirty_info - dirty limits and counts of current's memcg
+ * @sys_available_mem: memory available for dirty pages system-wide
+ * @info: filled in with the limits and counts, in pages
+ *
+ * Returns false if current is not subject to memcg dirty limits, that is
+ * when memcg is disabled or current is in the root cgroup.
+ */
+bool mem_cgroup_dirty_info(unsigned long sys_available_mem,
+			   struct mem_cgroup_dirty_info *info)
+{
+	struct mem_cgroup *mem;
+	bool ret = false;
+
+	if (mem_cgroup_disabled())
+		return false;
+
+	rcu_read_lock();
+	mem = mem_cgroup_from_task(current);
+	if (mem && !mem_cgroup_is_root(mem) && css_tryget(&mem->css))
+		ret = true;
+	rcu_read_unlock();
+	if (!ret)
+		return false;
+
+	__mem_cgroup_dirty_info(mem, sys_available_mem, info);
+	css_put(&mem->css);
+	return true;
+}
+
+/*
+ * Whether any memcg has more dirty pages than its background threshold.
+ * The flusher threads keep doing background writeback while this is
+ * true, as tasks throttled in such a memcg depend on it.
+ */
+bool mem_cgroups_over_bground_dirty_thresh(void)
+{
+	struct mem_cgroup_dirty_info info;
+	struct mem_cgroup *iter;
+	unsigned long sys_available_mem;
+	bool over = false;
+
+	if (mem_cgroup_disabled())
+		return false;
+
+	sys_available_mem = determine_dirtyable_memory();
+	for_each_mem_cgroup_tree_cond(iter, NULL, !over) {
+		if (mem_cgroup_is_root(iter))
+			continue;
+		__mem_cgroup_dirty_info(iter, sys_available_mem, &info);
+		if (info.nr_file_dirty + info.nr_unstable_nfs >
+		    info.background_thresh)
+			over = true;
+	}
+	return over;
+}
+
 static void __mem_cgroup_threshold(struct mem_cgroup *memcg, bool swap)
 {
 	struct mem_cgroup_threshold_ary *t;
@@ -4095,6 +4602,30 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "dirty_ratio",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_string = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_RATIO,
+	},
+	{
+		.name = "dirty_limit_in_bytes",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_string = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_LIMIT_IN_BYTES,
+	},
+	{
+		.name = "dirty_background_ratio",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_string = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_BACKGROUND_RATIO,
+	},
+	{
+		.name = "dirty_background_limit_in_bytes",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_string = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_BACKGROUND_LIMIT_IN_BYTES,
+	},
 	{
 		.name = "move_charge_at_immigrate",
 		.read_u64 = mem_cgroup_move_charge_read,
@@ -4367,8 +4898,10 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	spin_lock_init(&mem->reclaim_param_lock);
 	INIT_LIST_HEAD(&mem->oom_notify);
 
-	if (parent)
+	if (parent) {
 		mem->swappiness = get_swappiness(parent);
+		get_dirty_param(parent, &mem->dirty_param);
+	}
 	atomic_set(&mem->refcnt, 1);
 	mem->move_charge_at_immigrate = 0;
 	mutex_init(&mem->thresholds_lock);
@@ -4452,7 +4985,8 @@ one_by_one:
 			batch_count = PRECHARGE_COUNT_AT_ONCE;
 			cond_resched();
 		}
-		ret = __mem_cgroup_try_charge(NULL, GFP_KERNEL, &mem, false);
+		ret = __mem_cgroup_try_charge(NULL, GFP_KERNEL, &mem, false,
+					      PAGE_SIZE);
 		if (ret || !mem)
 			/* mem_cgroup_clear_mc() will do uncharge later */
 			return -ENOMEM;
@@ -4614,6 +5148,8 @@ static int mem_cgroup_count_precharge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
+	split_huge_page_pmd(walk->mm, pmd);
+
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE)
 		if (is_target_pte_for_mc(vma, addr, *pte, NULL))
@@ -4764,6 +5300,7 @@ static int mem_cgroup_move_charge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
+	split_huge_page_pmd(walk->mm, pmd);
 retry:
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; addr += PAGE_SIZE) {
@@ -4785,7 +5322,8 @@ retry:
 				goto put;
 			pc = lookup_page_cgroup(page);
 			if (!mem_cgroup_move_account(pc,
-						mc.from, mc.to, false)) {
+						mc.from, mc.to, false,
+						PAGE_SIZE)) {
 				mc.precharge--;
 				/* we uncharge from mc.from later. */
 				mc.moved_charge++;
@@ -873,6 +873,24 @@ static int hwpoison_user_mappings(struct page *p, unsigned long pfn,
 		ttu |= TTU_IGNORE_HWPOISON;
 	}
 
+	if (PageTransHuge(hpage)) {
+		/*
+		 * Verify that this isn't a hugetlbfs head page; the PageAnon
+		 * check keeps us away from split_huge_page's internal debug
+		 * checks. PageAnon can't go away from under us because we
+		 * hold a refcount on the hpage, which is also what makes
+		 * calling split_huge_page safe at all.
+		 */
+		if (!PageHuge(hpage) && PageAnon(hpage)) {
+			if (unlikely(split_huge_page(hpage))) {
+				printk(KERN_INFO
+				       "MCE %#lx: failed to split THP\n", pfn);
+				return SWAP_FAIL;
+			}
+			hpage = p;
+		}
+	}
+
 	/*
 	 * Propagate the dirty bit from PTEs to struct page first, because we
 	 * need this to decide if we should kill or just drop the page.
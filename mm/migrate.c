@@ -630,6 +630,13 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 		/* page was freed from under us. So we are done. */
 		goto move_newpage;
 	}
+	if (unlikely(PageTransHuge(page))) {
+		/* a huge pmd cannot be migrated, only its small pages */
+		if (unlikely(split_huge_page(page))) {
+			rc = -EBUSY;
+			goto move_newpage;
+		}
+	}
 
 	/* prepare cgroup just returns 0 or -ENOMEM */
 	rc = -EAGAIN;
@@ -1351,3 +1358,79 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA placement only moves a page if the target node has room
+ * to spare: it is not worth pushing the node into reclaim for locality.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+		if (zone_watermark_ok(zone, 0,
+				      high_wmark_pages(zone) + SWAP_CLUSTER_MAX,
+				      0, 0))
+			return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data,
+					     int **result)
+{
+	int nid = (int) data;
+
+	return alloc_pages_exact_node(nid,
+				GFP_HIGHUSER_MOVABLE | GFP_THISNODE |
+				__GFP_NOMEMALLOC | __GFP_NORETRY |
+				__GFP_NOWARN, 0);
+}
+
+/*
+ * Called from a NUMA hinting fault with a reference on @page, which is
+ * consumed.  Moves the page to @node and returns 1, or leaves it where it
+ * is and returns 0.  Only pages mapped by the faulting task alone are moved,
+ * and only towards the node the task has settled on, so that pages shared
+ * between nodes do not bounce back and forth.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	int preferred = current->numa_preferred_nid;
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	if (page_mapcount(page) != 1 || PageTransHuge(page) || PageKsm(page))
+		goto out;
+	if (preferred != -1 && preferred != node)
+		goto out;
+	if (!migrate_balanced_pgdat(NODE_DATA(node)))
+		goto out;
+	if (isolate_lru_page(page))
+		goto out;
+
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+	/* isolation holds its own reference now */
+	put_page(page);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, 0);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+
+out:
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
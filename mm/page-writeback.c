@@ -34,27 +34,24 @@
 #include <linux/syscalls.h>
 #include <linux/buffer_head.h>
 #include <linux/pagevec.h>
+#include <linux/memcontrol.h>
 #include <trace/events/writeback.h>
 
 /*
- * After a CPU has dirtied this many pages, balance_dirty_pages_ratelimited
- * will look to see if it needs to force writeback or throttling.
+ * Sleep at most 200ms at a time in balance_dirty_pages().
  */
-static long ratelimit_pages = 32;
+#define MAX_PAUSE		max(HZ/5, 1)
 
 /*
- * When balance_dirty_pages decides that the caller needs to perform some
- * non-background writeback, this is how many pages it will attempt to write.
- * It should be somewhat larger than dirtied pages to ensure that reasonably
- * large amounts of I/O are submitted.
+ * Fixed point shift for the dirty position ratio.
  */
-static inline long sync_writeback_pages(unsigned long dirtied)
-{
-	if (dirtied < ratelimit_pages)
-		dirtied = ratelimit_pages;
+#define RATELIMIT_CALC_SHIFT	10
 
-	return dirtied + dirtied / 2;
-}
+/*
+ * Upper bound on the number of pages a task may dirty before it calls into
+ * balance_dirty_pages() again, see writeback_set_ratelimit().
+ */
+static long ratelimit_pages = 32;
 
 /* The following parameters are exported via /proc/sys/vm */
 
@@ -219,6 +216,7 @@ int dirty_bytes_handler(struct ctl_table *table, int write,
  */
 static inline void __bdi_writeout_inc(struct backing_dev_info *bdi)
 {
+	__inc_bdi_stat(bdi, BDI_WRITTEN);
 	__prop_inc_percpu_max(&vm_completions, &bdi->completions,
 			      bdi->max_prop_frac);
 }
@@ -465,48 +463,157 @@ unsigned long bdi_dirty_limit(struct backing_dev_info *bdi, unsigned long dirty)
 	return bdi_dirty;
 }
 
+/*
+ * Number of pages a task may dirty before calling balance_dirty_pages()
+ * again: the square root of the distance to the threshold, so that the
+ * checks become more frequent as the dirty pages approach it.
+ */
+static unsigned long dirty_poll_interval(unsigned long dirty,
+					 unsigned long thresh)
+{
+	unsigned long pages = 1;
+
+	if (thresh > dirty)
+		pages = 1UL << (ilog2(thresh - dirty) >> 1);
+
+	return min_t(unsigned long, pages, ratelimit_pages);
+}
+
+/*
+ * Dirty position control.
+ *
+ * A throttled task is allowed to dirty pages at the write bandwidth of its
+ * bdi, scaled by the position ratio returned here.  The ratio drops as the
+ * dirty pages rise above the freerun point (halfway between the background
+ * and the dirty threshold): globally it falls linearly from 1 at freerun to
+ * 0 at dirty_thresh, the hard limit.  The bdi part falls linearly from 1 at
+ * half of bdi_thresh to 1/8 at bdi_thresh and beyond; the bdi limit is a
+ * soft one, it must not stall a bdi whose share of the limit is still
+ * ramping up.
+ *
+ * The more tasks dirty a bdi, the further the dirty pages climb before
+ * their combined dirty rate matches what the bdi can write, which is the
+ * balance point.
+ */
+static unsigned long dirty_freerun_ratio(unsigned long thresh,
+					 unsigned long freerun,
+					 unsigned long dirty)
+{
+	if (dirty >= thresh)
+		return 0;
+	return ((thresh - dirty) << RATELIMIT_CALC_SHIFT) /
+	       (thresh - freerun + 1);
+}
+
+static unsigned long dirty_pos_ratio(unsigned long thresh,
+				     unsigned long freerun,
+				     unsigned long dirty,
+				     unsigned long bdi_thresh,
+				     unsigned long bdi_dirty)
+{
+	unsigned long pos_ratio;
+	unsigned long bdi_ratio;
+	unsigned long span;
+
+	pos_ratio = dirty_freerun_ratio(thresh, freerun, dirty);
+	if (!pos_ratio)
+		return 0;
+
+	span = bdi_thresh / 2 + 1;
+	if (bdi_dirty + span <= bdi_thresh)
+		bdi_ratio = 1 << RATELIMIT_CALC_SHIFT;
+	else if (bdi_dirty >= bdi_thresh)
+		bdi_ratio = 1 << (RATELIMIT_CALC_SHIFT - 3);
+	else
+		bdi_ratio = ((bdi_thresh - bdi_dirty) << RATELIMIT_CALC_SHIFT) /
+			    span;
+	bdi_ratio = max_t(unsigned long, bdi_ratio,
+			  1 << (RATELIMIT_CALC_SHIFT - 3));
+
+	return (pos_ratio * bdi_ratio) >> RATELIMIT_CALC_SHIFT;
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
- * data.  It looks at the number of dirty pages in the machine and will force
- * the caller to perform writeback if the system is over `vm_dirty_ratio'.
- * If we're over `background_thresh' then the writeback threads are woken to
- * perform some writeout.
+ * data.  It looks at the number of dirty pages in the machine and will make
+ * the caller sleep for a while if the system is over the freerun point
+ * between `dirty_background_ratio' and `vm_dirty_ratio'.  The writeback
+ * itself is left to the flusher threads, which are woken up to perform
+ * background writeout if they are not already running.
+ *
+ * The length of the pause follows from the number of pages the task has
+ * dirtied and the rate it is allowed to dirty at, which is derived from
+ * the estimated write bandwidth of the bdi, see dirty_pos_ratio().
+ *
+ * A task in a memory cgroup is held to the dirty limits of its cgroup as
+ * well, with the same position control; whichever of the two is closer to
+ * its limit sets the rate.
  */
 static void balance_dirty_pages(struct address_space *mapping,
-				unsigned long write_chunk)
+				unsigned long pages_dirtied)
 {
-	long nr_reclaimable, bdi_nr_reclaimable;
-	long nr_writeback, bdi_nr_writeback;
+	unsigned long nr_reclaimable, bdi_reclaimable;
+	unsigned long nr_dirty;	 /* = file_dirty + writeback + unstable_nfs */
+	unsigned long bdi_dirty;
+	unsigned long freerun;
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
-	unsigned long pages_written = 0;
-	unsigned long pause = 1;
+	unsigned long task_ratelimit;
+	unsigned long pos_ratio;
+	long pause = 0;
 	bool dirty_exceeded = false;
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long start_time = jiffies;
+	struct mem_cgroup_dirty_info memcg_info;
+	unsigned long memcg_reclaimable = 0;
+	unsigned long memcg_dirty = 0;
+	unsigned long memcg_freerun = 0;
+	bool memcg;
 
 	for (;;) {
-		struct writeback_control wbc = {
-			.sync_mode	= WB_SYNC_NONE,
-			.older_than_this = NULL,
-			.nr_to_write	= write_chunk,
-			.range_cyclic	= 1,
-		};
-
 		nr_reclaimable = global_page_state(NR_FILE_DIRTY) +
 					global_page_state(NR_UNSTABLE_NFS);
-		nr_writeback = global_page_state(NR_WRITEBACK);
+		nr_dirty = nr_reclaimable + global_page_state(NR_WRITEBACK);
 
 		global_dirty_limits(&background_thresh, &dirty_thresh);
 
+		memcg = mem_cgroup_dirty_info(determine_dirtyable_memory(),
+					      &memcg_info);
+		if (memcg) {
+			memcg_reclaimable = memcg_info.nr_file_dirty +
+					    memcg_info.nr_unstable_nfs;
+			memcg_dirty = memcg_reclaimable +
+				      memcg_info.nr_writeback;
+			memcg_freerun = (memcg_info.background_thresh +
+					 memcg_info.dirty_thresh) / 2;
+		}
+
 		/*
 		 * Throttle it only when the background writeback cannot
 		 * catch-up. This avoids (excessively) small writeouts
 		 * when the bdi limits are ramping up.
 		 */
-		if (nr_reclaimable + nr_writeback <=
-				(background_thresh + dirty_thresh) / 2)
+		freerun = (background_thresh + dirty_thresh) / 2;
+		if (nr_dirty <= freerun &&
+		    (!memcg || memcg_dirty <= memcg_freerun)) {
+			current->nr_dirtied = 0;
+			current->nr_dirtied_pause =
+				dirty_poll_interval(nr_dirty, freerun);
+			if (memcg)
+				current->nr_dirtied_pause =
+					min_t(int, current->nr_dirtied_pause,
+					    dirty_poll_interval(memcg_dirty,
+								memcg_freerun));
 			break;
+		}
+
+		/*
+		 * The flusher threads do all the writeback; in laptop mode
+		 * this is where they get started.
+		 */
+		if (unlikely(!writeback_in_progress(bdi)))
+			bdi_start_background_writeback(bdi);
 
 		bdi_thresh = bdi_dirty_limit(bdi, dirty_thresh);
 		bdi_thresh = task_dirty_limit(current, bdi_thresh);
@@ -522,11 +629,13 @@ static void balance_dirty_pages(struct address_space *mapping,
 		 * deltas.
 		 */
 		if (bdi_thresh < 2*bdi_stat_error(bdi)) {
-			bdi_nr_reclaimable = bdi_stat_sum(bdi, BDI_RECLAIMABLE);
-			bdi_nr_writeback = bdi_stat_sum(bdi, BDI_WRITEBACK);
+			bdi_reclaimable = bdi_stat_sum(bdi, BDI_RECLAIMABLE);
+			bdi_dirty = bdi_reclaimable +
+				    bdi_stat_sum(bdi, BDI_WRITEBACK);
 		} else {
-			bdi_nr_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
-			bdi_nr_writeback = bdi_stat(bdi, BDI_WRITEBACK);
+			bdi_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
+			bdi_dirty = bdi_reclaimable +
+				    bdi_stat(bdi, BDI_WRITEBACK);
 		}
 
 		/*
@@ -535,44 +644,71 @@ static void balance_dirty_pages(struct address_space *mapping,
 		 * bdi or process from holding back light ones; The latter is
 		 * the last resort safeguard.
 		 */
-		dirty_exceeded =
-			(bdi_nr_reclaimable + bdi_nr_writeback > bdi_thresh)
-			|| (nr_reclaimable + nr_writeback > dirty_thresh);
-
-		if (!dirty_exceeded)
-			break;
-
-		if (!bdi->dirty_exceeded)
+		dirty_exceeded = (bdi_dirty > bdi_thresh) ||
+				 (nr_dirty > dirty_thresh) ||
+				 (memcg && memcg_dirty > memcg_info.dirty_thresh);
+		if (dirty_exceeded && !bdi->dirty_exceeded)
 			bdi->dirty_exceeded = 1;
 
-		/* Note: nr_reclaimable denotes nr_dirty + nr_unstable.
-		 * Unstable writes are a feature of certain networked
-		 * filesystems (i.e. NFS) in which data may have been
-		 * written to the server's write cache, but has not yet
-		 * been flushed to permanent storage.
-		 * Only move pages to writeback if this bdi is over its
-		 * threshold otherwise wait until the disk writes catch
-		 * up.
-		 */
-		trace_wbc_balance_dirty_start(&wbc, bdi);
-		if (bdi_nr_reclaimable > bdi_thresh) {
-			writeback_inodes_wb(&bdi->wb, &wbc);
-			pages_written += write_chunk - wbc.nr_to_write;
-			trace_wbc_balance_dirty_written(&wbc, bdi);
-			if (pages_written >= write_chunk)
-				break;		/* We've done our duty */
-		}
-		trace_wbc_balance_dirty_wait(&wbc, bdi);
-		__set_current_state(TASK_INTERRUPTIBLE);
+		bdi_update_bandwidth(bdi, start_time);
+
+		pos_ratio = dirty_pos_ratio(dirty_thresh, freerun, nr_dirty,
+					    bdi_thresh, bdi_dirty);
+		if (memcg)
+			pos_ratio = min(pos_ratio,
+					dirty_freerun_ratio(memcg_info.dirty_thresh,
+							    memcg_freerun,
+							    memcg_dirty));
+		task_ratelimit = ((u64)bdi->avg_write_bandwidth * pos_ratio) >>
+							RATELIMIT_CALC_SHIFT;
+		if (likely(task_ratelimit)) {
+			pause = HZ * pages_dirtied / task_ratelimit;
+			if (pause == 0) {
+				/*
+				 * Less than a jiffy worth of pages: keep
+				 * counting them and come back once there are
+				 * enough for a pause.
+				 */
+				current->nr_dirtied_pause =
+					task_ratelimit / HZ + 1;
+				break;
+			}
+			pause = min_t(long, pause, MAX_PAUSE);
+		} else
+			pause = MAX_PAUSE;
+
+		trace_balance_dirty_pages(bdi,
+					  dirty_thresh,
+					  background_thresh,
+					  nr_dirty,
+					  bdi_thresh,
+					  bdi_dirty,
+					  task_ratelimit,
+					  pages_dirtied,
+					  pause,
+					  start_time);
+		__set_current_state(TASK_KILLABLE);
 		io_schedule_timeout(pause);
 
+		current->nr_dirtied = 0;
+		current->nr_dirtied_pause =
+			dirty_poll_interval(nr_dirty, dirty_thresh);
+		if (memcg)
+			current->nr_dirtied_pause =
+				min_t(int, current->nr_dirtied_pause,
+				    dirty_poll_interval(memcg_dirty,
+						memcg_info.dirty_thresh));
+
 		/*
-		 * Increase the delay for each loop, up to our previous
-		 * default of taking a 100ms nap.
+		 * Below the hard limit one pause, sized for the pages
+		 * dirtied, is all it takes.  Above it keep sleeping until
+		 * the flusher brings the dirty pages back down.
 		 */
-		pause <<= 1;
-		if (pause > HZ / 10)
-			pause = HZ / 10;
+		if (task_ratelimit)
+			break;
+
+		if (fatal_signal_pending(current))
+			break;
 	}
 
 	if (!dirty_exceeded && bdi->dirty_exceeded)
@@ -589,8 +725,11 @@ static void balance_dirty_pages(struct address_space *mapping,
 	 * In normal mode, we start background writeout at the lower
 	 * background_thresh, to keep the amount of dirty memory low.
 	 */
-	if ((laptop_mode && pages_written) ||
-	    (!laptop_mode && (nr_reclaimable > background_thresh)))
+	if (laptop_mode)
+		return;
+
+	if (nr_reclaimable > background_thresh ||
+	    (memcg && memcg_reclaimable > memcg_info.background_thresh))
 		bdi_start_background_writeback(bdi);
 }
 
@@ -604,8 +743,6 @@ void set_page_dirty_balance(struct page *page, int page_mkwrite)
 	}
 }
 
-static DEFINE_PER_CPU(unsigned long, bdp_ratelimits) = 0;
-
 /**
  * balance_dirty_pages_ratelimited_nr - balance dirty memory state
  * @mapping: address_space which was dirtied
@@ -623,28 +760,19 @@ static DEFINE_PER_CPU(unsigned long, bdp_ratelimits) = 0;
 void balance_dirty_pages_ratelimited_nr(struct address_space *mapping,
 					unsigned long nr_pages_dirtied)
 {
-	unsigned long ratelimit;
-	unsigned long *p;
-
-	ratelimit = ratelimit_pages;
-	if (mapping->backing_dev_info->dirty_exceeded)
-		ratelimit = 8;
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	int ratelimit;
 
-	/*
-	 * Check the rate limiting. Also, we do not want to throttle real-time
-	 * tasks in balance_dirty_pages(). Period.
-	 */
-	preempt_disable();
-	p =  &__get_cpu_var(bdp_ratelimits);
-	*p += nr_pages_dirtied;
-	if (unlikely(*p >= ratelimit)) {
-		ratelimit = sync_writeback_pages(*p);
-		*p = 0;
-		preempt_enable();
-		balance_dirty_pages(mapping, ratelimit);
+	if (!bdi_cap_account_dirty(bdi))
 		return;
-	}
-	preempt_enable();
+
+	ratelimit = current->nr_dirtied_pause;
+	if (bdi->dirty_exceeded)
+		ratelimit = min(ratelimit, 32 >> (PAGE_SHIFT - 10));
+
+	current->nr_dirtied += nr_pages_dirtied;
+	if (unlikely(current->nr_dirtied >= ratelimit))
+		balance_dirty_pages(mapping, current->nr_dirtied);
 }
 EXPORT_SYMBOL(balance_dirty_pages_ratelimited_nr);
 
@@ -741,11 +869,9 @@ void laptop_sync_completion(void)
  * dirtying in parallel, we cannot go more than 3% (1/32) over the dirty memory
  * thresholds before writeback cuts in.
  *
- * But the limit should not be set too high.  Because it also controls the
- * amount of memory which the balance_dirty_pages() caller has to write back.
- * If this is too large then the caller will block on the IO queue all the
- * time.  So limit it to four megabytes - the balance_dirty_pages() caller
- * will write six megabyte chunks, max.
+ * But the limit should not be set too high.  Because it also controls how
+ * many pages a task may dirty between two throttling pauses, and the pause
+ * grows with it.  So limit it to four megabytes.
  */
 
 void writeback_set_ratelimit(void)
@@ -1036,11 +1162,17 @@ static int __writepage(struct page *page, struct writeback_control *wbc,
 int generic_writepages(struct address_space *mapping,
 		       struct writeback_control *wbc)
 {
+	struct blk_plug plug;
+	int ret;
+
 	/* deal with chardevs and other special file */
 	if (!mapping->a_ops->writepage)
 		return 0;
 
-	return write_cache_pages(mapping, wbc, __writepage, mapping);
+	blk_start_plug(&plug);
+	ret = write_cache_pages(mapping, wbc, __writepage, mapping);
+	blk_finish_plug(&plug);
+	return ret;
 }
 
 EXPORT_SYMBOL(generic_writepages);
@@ -1114,6 +1246,7 @@ int __set_page_dirty_no_writeback(struct page *page)
 void account_page_dirtied(struct page *page, struct address_space *mapping)
 {
 	if (mapping_cap_account_dirty(mapping)) {
+		mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_DIRTIED);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
@@ -1130,6 +1263,7 @@ EXPORT_SYMBOL(account_page_dirtied);
  */
 void account_page_writeback(struct page *page)
 {
+	mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_WRITEBACK);
 	inc_zone_page_state(page, NR_WRITEBACK);
 	inc_zone_page_state(page, NR_WRITTEN);
 }
@@ -1303,6 +1437,7 @@ int clear_page_dirty_for_io(struct page *page)
 		 * for more comments.
 		 */
 		if (TestClearPageDirty(page)) {
+			mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_DIRTY);
 			dec_zone_page_state(page, NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
@@ -1338,8 +1473,10 @@ int test_clear_page_writeback(struct page *page)
 	} else {
 		ret = TestClearPageWriteback(page);
 	}
-	if (ret)
+	if (ret) {
+		mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_WRITEBACK);
 		dec_zone_page_state(page, NR_WRITEBACK);
+	}
 	return ret;
 }
 
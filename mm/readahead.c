@@ -18,15 +18,27 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
+ *
+ * The window is seeded from the last one submitted on this mapping, so a
+ * new open that carries on where an earlier reader stopped is recognised
+ * as sequential straight away instead of ramping up from scratch.  Where
+ * that reader's marker sat is not kept, so the seed has no async part:
+ * only a read right at the end of the old window continues it.
  */
 void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = mapping->backing_dev_info->ra_pages;
 	ra->prev_pos = -1;
+	ra->start = mapping->ra_hist_start;
+	ra->size = mapping->ra_hist_size;
+	ra->async_size = 0;
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
@@ -109,9 +121,12 @@ EXPORT_SYMBOL(read_cache_pages);
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
+	struct blk_plug plug;
 	unsigned page_idx;
 	int ret;
 
+	blk_start_plug(&plug);
+
 	if (mapping->a_ops->readpages) {
 		ret = mapping->a_ops->readpages(filp, mapping, pages, nr_pages);
 		/* Clean up the remaining pages */
@@ -130,6 +145,7 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	}
 	ret = 0;
 out:
+	blk_finish_plug(&plug);
 	return ret;
 }
 
@@ -328,6 +344,13 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
  * it approaches max_readhead.
+ *
+ * Small reads that are neither sequential nor interleaved are checked against
+ * prev_pos for two more patterns: a strided scan repeats the gap it skipped
+ * after the previous read (kept in ra->stride), and a backwards scan ends just
+ * below where the previous read began.  Each decision is reported by the
+ * readahead tracepoint, with ra->pattern recording the kind of window last
+ * set up.
  */
 
 /*
@@ -383,6 +406,60 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Strided reads: same-sized reads separated by a fixed gap, as from a scan
+ * of one column of fixed-size records, or several threads splitting a
+ * file round-robin on one fd.  Read the next strides up to the window
+ * size, and flag the first page of the last one so that reaching it
+ * fetches the next batch.  For a miss the current read is included.
+ */
+static unsigned long
+stride_readahead(struct address_space *mapping, struct file_ra_state *ra,
+		 struct file *filp, pgoff_t offset, unsigned long req_size,
+		 unsigned long max, bool include_current)
+{
+	unsigned long step = req_size - 1 + ra->stride;
+	unsigned long nr_strides = max(max / req_size, 1UL);
+	unsigned long actual = 0;
+	unsigned long i;
+
+	if (include_current)
+		actual = __do_page_cache_readahead(mapping, filp,
+						   offset, req_size, 0);
+	for (i = 1; i <= nr_strides; i++)
+		actual += __do_page_cache_readahead(mapping, filp,
+					offset + i * step, req_size,
+					i == nr_strides ? req_size : 0);
+
+	/* the marker page: a hit there continues the stride */
+	ra->start = offset + nr_strides * step;
+	ra->size = req_size;
+	ra->async_size = 0;
+	ra->pattern = RA_PATTERN_STRIDE;
+	return actual;
+}
+
+/*
+ * A read that ends just below where the previous one started: a backwards
+ * scan.  Read the window below the current read, ramping it up while the
+ * scan keeps hitting the bottom of the previous window.
+ */
+static void backwards_ra_window(struct file_ra_state *ra, pgoff_t offset,
+				unsigned long req_size, unsigned long max)
+{
+	pgoff_t end = offset + req_size;
+	unsigned long size;
+
+	if (ra->pattern == RA_PATTERN_BACKWARDS && end == ra->start)
+		size = get_next_ra_size(ra, max);
+	else
+		size = get_init_ra_size(req_size, max);
+
+	ra->start = end > size ? end - size : 0;
+	ra->size = end - ra->start;
+	ra->async_size = 0;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -393,6 +470,9 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	unsigned long max = max_sane_readahead(ra->ra_pages);
+	pgoff_t prev_offset = ra->prev_pos >> PAGE_CACHE_SHIFT;
+	unsigned int pattern;
+	unsigned long actual;
 
 	/*
 	 * start of file
@@ -409,9 +489,21 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SUBSEQUENT;
 		goto readit;
 	}
 
+	/*
+	 * Hit the marker left on the last stride: keep striding.
+	 */
+	if (hit_readahead_marker && ra->pattern == RA_PATTERN_STRIDE &&
+	    offset == ra->start && ra->stride) {
+		actual = stride_readahead(mapping, ra, filp, offset,
+					  req_size, max, false);
+		pattern = RA_PATTERN_STRIDE;
+		goto out;
+	}
+
 	/*
 	 * Hit a marked page without valid readahead state.
 	 * E.g. interleaved reads.
@@ -433,35 +525,74 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_MARKER;
 		goto readit;
 	}
 
 	/*
 	 * oversize read
 	 */
-	if (req_size > max)
-		goto initial_readahead;
+	if (req_size > max) {
+		pattern = RA_PATTERN_OVERSIZE;
+		goto initial_readahead_pattern;
+	}
 
 	/*
 	 * sequential cache miss
 	 */
-	if (offset - (ra->prev_pos >> PAGE_CACHE_SHIFT) <= 1UL)
+	if (offset - prev_offset <= 1UL)
 		goto initial_readahead;
 
+	if (ra->prev_pos != -1) {
+		/*
+		 * The same gap skipped after the previous read as before
+		 * it: a strided scan.  Otherwise remember the gap.
+		 */
+		if (offset > prev_offset + 1) {
+			unsigned long gap = offset - prev_offset;
+
+			if (gap == ra->stride) {
+				actual = stride_readahead(mapping, ra, filp,
+						offset, req_size, max, true);
+				pattern = RA_PATTERN_STRIDE;
+				goto out;
+			}
+			ra->stride = gap <= max ? gap : 0;
+		}
+
+		/*
+		 * Ends right below the previous read, assuming the reads
+		 * are of the same size: a backwards scan.
+		 */
+		if (offset + req_size <= prev_offset + 1 &&
+		    prev_offset + 1 - offset <= 2 * req_size) {
+			backwards_ra_window(ra, offset, req_size, max);
+			pattern = RA_PATTERN_BACKWARDS;
+			goto readit;
+		}
+	}
+
 	/*
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	actual = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_readahead(mapping, offset, req_size, RA_PATTERN_RANDOM,
+			offset, req_size, 0, actual, hit_readahead_marker);
+	return actual;
 
 initial_readahead:
+	pattern = RA_PATTERN_INITIAL;
+initial_readahead_pattern:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -477,7 +608,18 @@ readit:
 		ra->size += ra->async_size;
 	}
 
-	return ra_submit(ra, mapping, filp);
+	ra->pattern = pattern;
+	actual = ra_submit(ra, mapping, filp);
+
+	/* leave the window for the next open of this file to pick up */
+	if (pattern != RA_PATTERN_BACKWARDS) {
+		mapping->ra_hist_start = ra->start;
+		mapping->ra_hist_size = ra->size;
+	}
+out:
+	trace_readahead(mapping, offset, req_size, pattern, ra->start,
+			ra->size, ra->async_size, actual, hit_readahead_marker);
+	return actual;
 }
 
 /**
@@ -836,6 +836,10 @@ static void shmem_evict_inode(struct inode *inode)
 	}
 	BUG_ON(inode->i_blocks);
 	shmem_free_inode(inode->i_sb);
+	if ((inode->i_mode & S_IFMT) == S_IFREG) {
+		/* not in ->destroy_inode, which may run from an RCU callback */
+		mpol_free_shared_policy(&info->policy);
+	}
 	end_writeback(inode);
 }
 
@@ -2417,10 +2421,6 @@ static struct inode *shmem_alloc_inode(struct super_block *sb)
 
 static void shmem_destroy_inode(struct inode *inode)
 {
-	if ((inode->i_mode & S_IFMT) == S_IFREG) {
-		/* only struct inode is valid if it's an inline symlink */
-		mpol_free_shared_policy(&SHMEM_I(inode)->policy);
-	}
 	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
 }
 
@@ -2549,6 +2549,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.mount		= shmem_mount,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_PATH_WALK,
 };
 
 int __init init_tmpfs(void)
@@ -157,6 +157,12 @@ int add_to_swap(struct page *page)
 	if (!entry.val)
 		return 0;
 
+	if (unlikely(PageTransHuge(page)))
+		if (unlikely(split_huge_page(page))) {
+			swapcache_free(entry, NULL);
+			return 0;
+		}
+
 	/*
 	 * Radix-tree node allocations from PF_MEMALLOC contexts could
 	 * completely exhaust the page allocator. __GFP_NOMEMALLOC
@@ -314,6 +320,12 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = swapcache_prepare(entry);
 		if (err == -EEXIST) {	/* seems racy */
 			radix_tree_preload_end();
+			/*
+			 * A freed slot stays reserved with SWAP_HAS_CACHE
+			 * until its free batch is flushed: don't wait on it.
+			 */
+			if (!swap_entry_count(entry))
+				break;
 			continue;
 		}
 		if (err) {		/* swp entry is obsolete ? */
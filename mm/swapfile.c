@@ -31,6 +31,8 @@
 #include <linux/syscalls.h>
 #include <linux/memcontrol.h>
 #include <linux/poll.h>
+#include <linux/zswap.h>
+#include <linux/cpu.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -211,6 +213,69 @@ static int wait_for_discard(void *word)
 
 #define SWAPFILE_CLUSTER	256
 #define LATENCY_LIMIT		256
+#define CLUSTER_NONE		(~0U)
+
+/*
+ * Solid state swap areas (that do not discard) track the slots in use per
+ * cluster, and hand out whole free clusters to the cpus allocating from
+ * them.  All of this is protected by swap_lock.
+ */
+static void inc_cluster_info(struct swap_info_struct *si, unsigned long offset)
+{
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = &si->cluster_info[offset / SWAPFILE_CLUSTER];
+	if (!ci->count++)
+		list_del_init(&ci->list);
+}
+
+static void dec_cluster_info(struct swap_info_struct *si, unsigned long offset)
+{
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = &si->cluster_info[offset / SWAPFILE_CLUSTER];
+	VM_BUG_ON(!ci->count);
+	if (!--ci->count)
+		list_add_tail(&ci->list, &si->free_clusters);
+}
+
+/*
+ * Find a free slot in this cpu's cluster, taking a new cluster off the
+ * free list when the current one is used up.  Returns 0 if there are no
+ * free clusters left, and the caller falls back to first-free scanning.
+ */
+static unsigned long scan_swap_map_cluster(struct swap_info_struct *si)
+{
+	struct percpu_cluster *pc = this_cpu_ptr(si->percpu_cluster);
+	struct swap_cluster_info *ci;
+	unsigned long offset, end;
+
+	for (;;) {
+		if (pc->index == CLUSTER_NONE) {
+			if (list_empty(&si->free_clusters))
+				return 0;
+			ci = list_first_entry(&si->free_clusters,
+					struct swap_cluster_info, list);
+			list_del_init(&ci->list);
+			pc->index = ci - si->cluster_info;
+			pc->next = pc->index * SWAPFILE_CLUSTER;
+		}
+
+		end = min_t(unsigned long, (pc->index + 1) * SWAPFILE_CLUSTER,
+				si->max);
+		for (offset = pc->next; offset < end; offset++) {
+			if (!si->swap_map[offset]) {
+				pc->next = offset + 1;
+				return offset;
+			}
+		}
+		pc->index = CLUSTER_NONE;
+	}
+}
 
 static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 					  unsigned char usage)
@@ -233,6 +298,11 @@ static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 	 */
 
 	si->flags += SWP_SCANNING;
+	if (si->cluster_info) {
+		scan_base = offset = scan_swap_map_cluster(si);
+		if (offset)
+			goto checks;
+	}
 	scan_base = offset = si->cluster_next;
 
 	if (unlikely(!si->cluster_nr--)) {
@@ -344,6 +414,7 @@ checks:
 		si->lowest_bit = si->max;
 		si->highest_bit = 0;
 	}
+	inc_cluster_info(si, offset);
 	si->swap_map[offset] = usage;
 	si->cluster_next = offset + 1;
 	si->flags -= SWP_SCANNING;
@@ -575,28 +646,130 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 		mem_cgroup_uncharge_swap(entry);
 
 	usage = count | has_cache;
-	p->swap_map[offset] = usage;
-
-	/* free if no reference */
-	if (!usage) {
-		struct gendisk *disk = p->bdev->bd_disk;
-		if (offset < p->lowest_bit)
-			p->lowest_bit = offset;
-		if (offset > p->highest_bit)
-			p->highest_bit = offset;
-		if (swap_list.next >= 0 &&
-		    p->prio > swap_info[swap_list.next]->prio)
-			swap_list.next = p->type;
-		nr_swap_pages++;
-		p->inuse_pages--;
-		if ((p->flags & SWP_BLKDEV) &&
-				disk->fops->swap_slot_free_notify)
-			disk->fops->swap_slot_free_notify(p->bdev, offset);
-	}
+
+	/*
+	 * No references left: keep the slot reserved with SWAP_HAS_CACHE
+	 * until the caller hands it to swap_free_slot_unlock(), which
+	 * releases it in a batch with others.
+	 */
+	p->swap_map[offset] = usage ? usage : SWAP_HAS_CACHE;
 
 	return usage;
 }
 
+/* Return a reserved slot to the free pool. Called under swap_lock. */
+static void swap_slot_release(struct swap_info_struct *p, unsigned long offset)
+{
+	struct gendisk *disk = p->bdev->bd_disk;
+
+	VM_BUG_ON(p->swap_map[offset] != SWAP_HAS_CACHE);
+	p->swap_map[offset] = 0;
+
+	if (offset < p->lowest_bit)
+		p->lowest_bit = offset;
+	if (offset > p->highest_bit)
+		p->highest_bit = offset;
+	if (swap_list.next >= 0 &&
+	    p->prio > swap_info[swap_list.next]->prio)
+		swap_list.next = p->type;
+	nr_swap_pages++;
+	p->inuse_pages--;
+	dec_cluster_info(p, offset);
+	zswap_invalidate_page(p->type, offset);
+	if ((p->flags & SWP_BLKDEV) &&
+			disk->fops->swap_slot_free_notify)
+		disk->fops->swap_slot_free_notify(p->bdev, offset);
+}
+
+/*
+ * Slots whose last reference went away are collected per cpu and
+ * released together, taking swap_lock once per batch.
+ */
+#define SWAP_FREE_BATCH		64
+
+struct swap_free_batch {
+	spinlock_t lock;
+	int nr;
+	swp_entry_t entries[SWAP_FREE_BATCH];
+};
+
+static DEFINE_PER_CPU(struct swap_free_batch, swap_free_batch);
+
+static void swap_free_batch_flush(struct swap_free_batch *batch)
+{
+	int i;
+
+	if (!batch->nr)
+		return;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < batch->nr; i++) {
+		swp_entry_t entry = batch->entries[i];
+
+		swap_slot_release(swap_info[swp_type(entry)],
+				  swp_offset(entry));
+	}
+	spin_unlock(&swap_lock);
+	batch->nr = 0;
+}
+
+static void swap_free_batch_drain(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_free_batch *batch = &per_cpu(swap_free_batch, cpu);
+
+		spin_lock(&batch->lock);
+		swap_free_batch_flush(batch);
+		spin_unlock(&batch->lock);
+	}
+}
+
+/*
+ * Wait for frees that have left swap_lock but not yet reached a batch,
+ * then release everything batched.  Once swapoff has cleared SWP_WRITEOK
+ * and called this, slots of that area are no longer batched.
+ */
+static void swap_free_batch_sync(void)
+{
+	synchronize_sched();
+	swap_free_batch_drain();
+}
+
+/*
+ * Release a slot that swap_entry_free() left reserved.  Called with
+ * swap_lock held, which it drops.  Batching is skipped when swap is
+ * nearly exhausted, so that slots waiting in the batches of idle cpus
+ * cannot make allocations fail, and once swapoff has started on the
+ * area, so that its swap_map is not left referenced from a batch.
+ */
+static void swap_free_slot_unlock(struct swap_info_struct *p,
+				  swp_entry_t entry)
+{
+	struct swap_free_batch *batch;
+
+	if (!(p->flags & SWP_WRITEOK) ||
+	    nr_swap_pages < num_online_cpus() * SWAP_FREE_BATCH * 2) {
+		swap_slot_release(p, swp_offset(entry));
+		spin_unlock(&swap_lock);
+		return;
+	}
+
+	/*
+	 * Preemption stays disabled from swap_lock to the batch, which is
+	 * what swap_free_batch_sync() waits for.
+	 */
+	batch = &get_cpu_var(swap_free_batch);
+	spin_unlock(&swap_lock);
+	spin_lock(&batch->lock);
+	batch->entries[batch->nr++] = entry;
+	if (batch->nr == SWAP_FREE_BATCH)
+		swap_free_batch_flush(batch);
+	spin_unlock(&batch->lock);
+	put_cpu_var(swap_free_batch);
+}
+
 /*
  * Caller has made sure that the swapdevice corresponding to entry
  * is still around or has not been recycled.
@@ -604,11 +777,15 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 void swap_free(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
+	unsigned char count;
 
 	p = swap_info_get(entry);
 	if (p) {
-		swap_entry_free(p, entry, 1);
-		spin_unlock(&swap_lock);
+		count = swap_entry_free(p, entry, 1);
+		if (!count)
+			swap_free_slot_unlock(p, entry);
+		else
+			spin_unlock(&swap_lock);
 	}
 }
 
@@ -625,7 +802,10 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 		count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
 		if (page)
 			mem_cgroup_uncharge_swapcache(page, entry, count != 0);
-		spin_unlock(&swap_lock);
+		if (!count)
+			swap_free_slot_unlock(p, entry);
+		else
+			spin_unlock(&swap_lock);
 	}
 }
 
@@ -649,6 +829,23 @@ static inline int page_swapcount(struct page *page)
 	return count;
 }
 
+/*
+ * How many references to the swap entry are there, not counting the swap
+ * cache?  Lets swapin notice that an entry it is waiting for was freed.
+ */
+int swap_entry_count(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+	int count = 0;
+
+	p = swap_info[swp_type(entry)];
+	spin_lock(&swap_lock);
+	if (swp_offset(entry) < p->max)
+		count = swap_count(p->swap_map[swp_offset(entry)]);
+	spin_unlock(&swap_lock);
+	return count;
+}
+
 /*
  * We can write to an anon page without COW if there are no other references
  * to it.  And as a side-effect, free up its swap: because the old content
@@ -719,20 +916,25 @@ int free_swap_and_cache(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
 	struct page *page = NULL;
+	unsigned char count;
 
 	if (non_swap_entry(entry))
 		return 1;
 
 	p = swap_info_get(entry);
 	if (p) {
-		if (swap_entry_free(p, entry, 1) == SWAP_HAS_CACHE) {
+		count = swap_entry_free(p, entry, 1);
+		if (count == SWAP_HAS_CACHE) {
 			page = find_get_page(&swapper_space, entry.val);
 			if (page && !trylock_page(page)) {
 				page_cache_release(page);
 				page = NULL;
 			}
 		}
-		spin_unlock(&swap_lock);
+		if (!count)
+			swap_free_slot_unlock(p, entry);
+		else
+			spin_unlock(&swap_lock);
 	}
 	if (page) {
 		/*
@@ -964,6 +1166,8 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
+		if (unlikely(pmd_trans_huge(*pmd)))
+			continue;
 		if (pmd_none_or_clear_bad(pmd))
 			continue;
 		ret = unuse_pte_range(vma, pmd, addr, next, entry, page);
@@ -1147,6 +1351,15 @@ static int try_to_unuse(unsigned int type)
 			 */
 			if (!*swap_map)
 				continue;
+			/*
+			 * Or it is being freed, or swapped in, right now:
+			 * give that a moment and look at the entry again.
+			 */
+			if (*swap_map == SWAP_HAS_CACHE) {
+				schedule_timeout_uninterruptible(1);
+				i--;
+				continue;
+			}
 			retval = -ENOMEM;
 			break;
 		}
@@ -1548,10 +1761,65 @@ bad_bmap:
 	goto out;
 }
 
+/*
+ * Set up the per cluster usage counts and the free cluster list of a
+ * solid state swap area, and the cluster each cpu allocates from.  The
+ * free list starts at the random cluster_next, to spread the wear.
+ */
+static int setup_swap_clusters(struct swap_info_struct *p,
+			       unsigned char *swap_map)
+{
+	unsigned long nr_clusters = DIV_ROUND_UP(p->max, SWAPFILE_CLUSTER);
+	unsigned long i, idx, offset;
+	int cpu;
+
+	p->cluster_info = vmalloc(nr_clusters * sizeof(*p->cluster_info));
+	if (!p->cluster_info)
+		return -ENOMEM;
+	p->percpu_cluster = alloc_percpu(struct percpu_cluster);
+	if (!p->percpu_cluster) {
+		vfree(p->cluster_info);
+		p->cluster_info = NULL;
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(p->percpu_cluster, cpu)->index = CLUSTER_NONE;
+
+	INIT_LIST_HEAD(&p->free_clusters);
+	for (i = 0; i < nr_clusters; i++) {
+		p->cluster_info[i].count = 0;
+		INIT_LIST_HEAD(&p->cluster_info[i].list);
+	}
+	for (offset = 0; offset < p->max; offset++)
+		if (swap_map[offset])
+			p->cluster_info[offset / SWAPFILE_CLUSTER].count++;
+
+	idx = p->cluster_next / SWAPFILE_CLUSTER;
+	for (i = 0; i < nr_clusters; i++) {
+		struct swap_cluster_info *ci = &p->cluster_info[idx];
+
+		if (!ci->count)
+			list_add_tail(&ci->list, &p->free_clusters);
+		if (++idx == nr_clusters)
+			idx = 0;
+	}
+	return 0;
+}
+
+static void free_swap_clusters(struct swap_info_struct *p)
+{
+	vfree(p->cluster_info);
+	p->cluster_info = NULL;
+	free_percpu(p->percpu_cluster);
+	p->percpu_cluster = NULL;
+}
+
 SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	struct swap_cluster_info *cluster_info;
+	struct percpu_cluster __percpu *percpu_cluster;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1614,6 +1882,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* From here on, slots of this area are released without batching */
+	swap_free_batch_sync();
+
 	current->flags |= PF_OOM_ORIGIN;
 	err = try_to_unuse(type);
 	current->flags &= ~PF_OOM_ORIGIN;
@@ -1666,10 +1937,17 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	cluster_info = p->cluster_info;
+	p->cluster_info = NULL;
+	percpu_cluster = p->percpu_cluster;
+	p->percpu_cluster = NULL;
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	vfree(cluster_info);
+	free_percpu(percpu_cluster);
+	zswap_invalidate_area(type);
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
 
@@ -1842,6 +2120,31 @@ static int __init max_swapfiles_check(void)
 late_initcall(max_swapfiles_check);
 #endif
 
+static int __cpuinit swap_free_batch_cpu_callback(struct notifier_block *nfb,
+					unsigned long action, void *hcpu)
+{
+	struct swap_free_batch *batch;
+
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN) {
+		batch = &per_cpu(swap_free_batch, (long)hcpu);
+		spin_lock(&batch->lock);
+		swap_free_batch_flush(batch);
+		spin_unlock(&batch->lock);
+	}
+	return NOTIFY_OK;
+}
+
+static int __init swap_free_batch_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(swap_free_batch, cpu).lock);
+	hotcpu_notifier(swap_free_batch_cpu_callback, 0);
+	return 0;
+}
+__initcall(swap_free_batch_init);
+
 /*
  * Written 01/25/92 by Simmule Turner, heavily changed by Linus.
  *
@@ -2095,6 +2398,16 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 			p->flags |= SWP_DISCARDABLE;
 	}
 
+	/*
+	 * Discarding areas keep scanning for free clusters themselves, so
+	 * that each new cluster can be discarded before it is used.
+	 */
+	if ((p->flags & (SWP_SOLIDSTATE | SWP_DISCARDABLE)) == SWP_SOLIDSTATE) {
+		error = setup_swap_clusters(p, swap_map);
+		if (error)
+			goto bad_swap;
+	}
+
 	mutex_lock(&swapon_mutex);
 	spin_lock(&swap_lock);
 	if (swap_flags & SWAP_FLAG_PREFER)
@@ -2140,6 +2453,7 @@ bad_swap:
 	}
 	destroy_swap_extents(p);
 	swap_cgroup_swapoff(type);
+	free_swap_clusters(p);
 bad_swap_2:
 	spin_lock(&swap_lock);
 	p->swap_file = NULL;
@@ -0,0 +1,644 @@
+/*
+ *  linux/mm/zswap.c
+ *
+ *  Compressed cache in front of the swap devices.
+ *
+ *  Pages handed to swap_writepage() are compressed with the crypto
+ *  API and kept in RAM instead of being written out. swap_readpage()
+ *  decompresses them back. The pool is bounded by max_pool_percent of
+ *  RAM: once it is full new pages go straight to the swap device and
+ *  a worker writes the oldest compressed pages back to their swap
+ *  slots to make room.
+ *
+ *  Entries are indexed by swap slot, one tree per swap type, so the
+ *  cache needs no change to the swap entry format: a slot is either
+ *  backed by a compressed copy here or by its blocks on disk.
+ *
+ *  This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/writeback.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/crypto.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/zswap.h>
+
+/*
+ * Tunables, writable at runtime through /sys/module/zswap/parameters
+ * or on the kernel command line as zswap.<name>=<value>.
+ */
+static int zswap_enabled __read_mostly;
+module_param_named(enabled, zswap_enabled, bool, 0644);
+
+/* compressor, fixed at boot */
+static char zswap_compressor[CRYPTO_MAX_ALG_NAME] = "lzo";
+module_param_string(compressor, zswap_compressor, sizeof(zswap_compressor),
+		    0444);
+
+/* upper bound of the compressed pool, in percent of RAM */
+static unsigned int zswap_max_pool_percent __read_mostly = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/*
+ * Pages that do not compress below this many percent of PAGE_SIZE are
+ * sent to the swap device: storing them would cost nearly as much
+ * memory as the page itself.
+ */
+static unsigned int zswap_max_compression_ratio __read_mostly = 80;
+module_param_named(max_compression_ratio, zswap_max_compression_ratio,
+		   uint, 0644);
+
+/*
+ * When the pool hits its limit the writeback worker frees entries
+ * until the pool is below this percentage of the limit again.
+ */
+#define ZSWAP_WRITEBACK_LOW_PERCENT	90
+/* entries examined by one run of the writeback worker */
+#define ZSWAP_WRITEBACK_BATCH		256
+
+/**
+ * struct zswap_entry - one compressed page
+ * @rbnode: links the entry into the tree of its swap type
+ * @lru: position in zswap_lru, oldest first
+ * @type: swap type of the slot
+ * @offset: swap offset of the slot
+ * @length: length of the compressed data
+ * @data: the compressed data, kmalloc'ed
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	struct list_head lru;
+	unsigned int type;
+	pgoff_t offset;
+	unsigned int length;
+	u8 *data;
+};
+
+/**
+ * struct zswap_tree - compressed pages of one swap type
+ * @rbroot: entries sorted by offset
+ * @lock: protects the tree and the statistics below
+ *
+ * The statistics are reset when the swap type is turned off.
+ */
+struct zswap_tree {
+	struct rb_root rbroot;
+	spinlock_t lock;
+	u64 stored_pages;
+	u64 pool_bytes;
+	u64 stores;
+	u64 loads;
+	u64 rejects;
+	u64 invalidates;
+	u64 written_back;
+};
+
+static struct zswap_tree zswap_trees[MAX_SWAPFILES];
+
+/* all entries, oldest first; protected by zswap_lru_lock */
+static LIST_HEAD(zswap_lru);
+static DEFINE_SPINLOCK(zswap_lru_lock);
+
+static struct kmem_cache *zswap_entry_cache;
+
+static DEFINE_PER_CPU(struct crypto_comp *, zswap_comp_tfm);
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+
+static void zswap_writeback_work(struct work_struct *work);
+static DECLARE_WORK(zswap_writeback_worker, zswap_writeback_work);
+
+/* global statistics, exported through debugfs */
+static atomic_long_t zswap_pool_bytes = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_stored_pages = ATOMIC_LONG_INIT(0);
+static u64 zswap_pool_limit_hit;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_written_back_pages;
+static u64 zswap_duplicate_entry;
+
+static int zswap_initialized __read_mostly;
+
+static unsigned long zswap_pool_limit(void)
+{
+	return totalram_pages * zswap_max_pool_percent / 100 * PAGE_SIZE;
+}
+
+static bool zswap_pool_full(void)
+{
+	return atomic_long_read(&zswap_pool_bytes) >= zswap_pool_limit();
+}
+
+/*
+ * rbtree helpers; the caller holds tree->lock.
+ */
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset > offset)
+			node = node->rb_left;
+		else if (entry->offset < offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Insert @entry, handing back any entry already stored for the same
+ * offset in @dupentry so the caller can drop it.
+ */
+static void zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
+			    struct zswap_entry **dupentry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	*dupentry = NULL;
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (myentry->offset > entry->offset)
+			link = &(*link)->rb_left;
+		else if (myentry->offset < entry->offset)
+			link = &(*link)->rb_right;
+		else {
+			*dupentry = myentry;
+			rb_replace_node(&myentry->rbnode, &entry->rbnode, root);
+			return;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+}
+
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	kfree(entry->data);
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+/*
+ * Unlink an entry that is no longer in the rbtree and account for it;
+ * the caller holds tree->lock and frees the entry afterwards.
+ */
+static void zswap_unaccount_entry(struct zswap_tree *tree,
+				  struct zswap_entry *entry)
+{
+	size_t size = ksize(entry->data);
+
+	spin_lock(&zswap_lru_lock);
+	list_del(&entry->lru);
+	spin_unlock(&zswap_lru_lock);
+
+	tree->stored_pages--;
+	tree->pool_bytes -= size;
+	atomic_long_dec(&zswap_stored_pages);
+	atomic_long_sub(size, &zswap_pool_bytes);
+}
+
+/* drop the entry stored for @offset, if any; tree->lock held */
+static struct zswap_entry *zswap_erase(struct zswap_tree *tree,
+				       pgoff_t offset)
+{
+	struct zswap_entry *entry;
+
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry) {
+		rb_erase(&entry->rbnode, &tree->rbroot);
+		zswap_unaccount_entry(tree, entry);
+	}
+	return entry;
+}
+
+/**
+ * zswap_store - compress a page into the cache
+ * @page: locked swap cache page about to be written out
+ *
+ * Returns 0 if the page is now held by the cache, in which case the
+ * swap device must not be written. On any failure the slot is left
+ * without a compressed copy so the caller's disk write is the only
+ * valid one.
+ */
+int zswap_store(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page) };
+	unsigned type = swp_type(swp);
+	pgoff_t offset = swp_offset(swp);
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	gfp_t gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_NOMEMALLOC;
+	unsigned int dlen = PAGE_SIZE * 2;
+	struct crypto_comp *tfm;
+	u8 *src, *dst;
+	int ret;
+
+	if (!zswap_initialized)
+		return -ENODEV;
+	ret = 0;
+	if (!zswap_enabled)
+		goto drop;
+
+	if (zswap_pool_full()) {
+		zswap_pool_limit_hit++;
+		schedule_work(&zswap_writeback_worker);
+		goto reject;
+	}
+
+	entry = kmem_cache_alloc(zswap_entry_cache, gfp);
+	if (!entry) {
+		zswap_reject_alloc_fail++;
+		goto reject;
+	}
+
+	/* the per-cpu tfm and buffer are only ours while preemption is off */
+	tfm = get_cpu_var(zswap_comp_tfm);
+	dst = __get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = crypto_comp_compress(tfm, src, PAGE_SIZE, dst, &dlen);
+	kunmap_atomic(src, KM_USER0);
+	if (ret || dlen > PAGE_SIZE * zswap_max_compression_ratio / 100) {
+		put_cpu_var(zswap_comp_tfm);
+		kmem_cache_free(zswap_entry_cache, entry);
+		zswap_reject_compress_poor++;
+		goto reject;
+	}
+	entry->data = kmalloc(dlen, gfp);
+	if (entry->data)
+		memcpy(entry->data, dst, dlen);
+	put_cpu_var(zswap_comp_tfm);
+	if (!entry->data) {
+		kmem_cache_free(zswap_entry_cache, entry);
+		zswap_reject_alloc_fail++;
+		goto reject;
+	}
+	entry->type = type;
+	entry->offset = offset;
+	entry->length = dlen;
+
+	spin_lock(&tree->lock);
+	zswap_rb_insert(&tree->rbroot, entry, &dupentry);
+	if (dupentry) {
+		/* the slot was rewritten, the old copy is stale */
+		zswap_duplicate_entry++;
+		zswap_unaccount_entry(tree, dupentry);
+	}
+	spin_lock(&zswap_lru_lock);
+	list_add_tail(&entry->lru, &zswap_lru);
+	spin_unlock(&zswap_lru_lock);
+	tree->stored_pages++;
+	tree->pool_bytes += ksize(entry->data);
+	tree->stores++;
+	atomic_long_inc(&zswap_stored_pages);
+	atomic_long_add(ksize(entry->data), &zswap_pool_bytes);
+	spin_unlock(&tree->lock);
+
+	if (dupentry)
+		zswap_free_entry(dupentry);
+	return 0;
+
+reject:
+	ret = -ENOSPC;
+drop:
+	spin_lock(&tree->lock);
+	if (ret)
+		tree->rejects++;
+	entry = zswap_erase(tree, offset);
+	spin_unlock(&tree->lock);
+	if (entry)
+		zswap_free_entry(entry);
+	return -ENOSPC;
+}
+
+/**
+ * zswap_load - fill a page from the cache
+ * @page: locked, not uptodate swap cache page
+ *
+ * Returns 0 if the page was found and decompressed. The compressed
+ * copy stays in the cache until the swap slot is freed or rewritten.
+ */
+int zswap_load(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page) };
+	struct zswap_tree *tree = &zswap_trees[swp_type(swp)];
+	struct zswap_entry *entry;
+	unsigned int dlen = PAGE_SIZE;
+	struct crypto_comp *tfm;
+	u8 *dst;
+	int ret;
+
+	if (!zswap_initialized)
+		return -ENOENT;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, swp_offset(swp));
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+	tfm = get_cpu_var(zswap_comp_tfm);
+	dst = kmap_atomic(page, KM_USER0);
+	ret = crypto_comp_decompress(tfm, entry->data, entry->length,
+				     dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	put_cpu_var(zswap_comp_tfm);
+	BUG_ON(ret || dlen != PAGE_SIZE);
+	tree->loads++;
+	spin_unlock(&tree->lock);
+
+	return 0;
+}
+
+/**
+ * zswap_invalidate_page - forget the compressed copy of a swap slot
+ * @type: swap type
+ * @offset: swap offset
+ *
+ * Called when the slot is freed, under swap_lock.
+ */
+void zswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!zswap_initialized)
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_erase(tree, offset);
+	if (entry)
+		tree->invalidates++;
+	spin_unlock(&tree->lock);
+	if (entry)
+		zswap_free_entry(entry);
+}
+
+/**
+ * zswap_invalidate_area - drop everything cached for a swap type
+ * @type: swap type being turned off
+ */
+void zswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	if (!zswap_initialized)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot))) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		rb_erase(node, &tree->rbroot);
+		zswap_unaccount_entry(tree, entry);
+		zswap_free_entry(entry);
+	}
+	tree->stored_pages = tree->pool_bytes = 0;
+	tree->stores = tree->loads = tree->rejects = 0;
+	tree->invalidates = tree->written_back = 0;
+	spin_unlock(&tree->lock);
+}
+
+/*
+ * Move the contents of a swap slot from the cache to the swap device.
+ *
+ * Reading the slot through the swap cache decompresses it into a
+ * page. With that page locked nobody can store a newer copy of the
+ * slot, so the compressed copy can be dropped and the page written to
+ * disk; until the write completes the swap cache serves the slot.
+ */
+static int zswap_writeback_slot(swp_entry_t swp)
+{
+	struct zswap_tree *tree = &zswap_trees[swp_type(swp)];
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+	struct zswap_entry *entry;
+	struct page *page;
+
+	page = read_swap_cache_async(swp, GFP_KERNEL, NULL, 0);
+	if (!page)
+		return -ENOMEM;		/* slot freed meanwhile */
+
+	lock_page(page);
+	if (!PageSwapCache(page) || page_private(page) != swp.val ||
+	    !PageUptodate(page) || PageWriteback(page)) {
+		unlock_page(page);
+		page_cache_release(page);
+		return -EAGAIN;
+	}
+
+	spin_lock(&tree->lock);
+	entry = zswap_erase(tree, swp_offset(swp));
+	if (entry)
+		tree->written_back++;
+	spin_unlock(&tree->lock);
+	if (!entry) {
+		/* invalidated or already on disk */
+		unlock_page(page);
+		page_cache_release(page);
+		return 0;
+	}
+	zswap_free_entry(entry);
+
+	clear_page_dirty_for_io(page);
+	/* let reclaim find the page right after the write completes */
+	SetPageReclaim(page);
+	__swap_writepage(page, &wbc);
+	page_cache_release(page);
+	zswap_written_back_pages++;
+
+	return 0;
+}
+
+static void zswap_writeback_work(struct work_struct *work)
+{
+	unsigned long low = zswap_pool_limit() / 100 *
+			    ZSWAP_WRITEBACK_LOW_PERCENT;
+	struct zswap_entry *entry;
+	swp_entry_t swp;
+	int batch = ZSWAP_WRITEBACK_BATCH;
+
+	while (atomic_long_read(&zswap_pool_bytes) > low && batch--) {
+		spin_lock(&zswap_lru_lock);
+		if (list_empty(&zswap_lru)) {
+			spin_unlock(&zswap_lru_lock);
+			break;
+		}
+		entry = list_first_entry(&zswap_lru, struct zswap_entry, lru);
+		/* rotate, so an entry that can't be written doesn't stall us */
+		list_move_tail(&entry->lru, &zswap_lru);
+		swp = swp_entry(entry->type, entry->offset);
+		spin_unlock(&zswap_lru_lock);
+
+		zswap_writeback_slot(swp);
+		cond_resched();
+	}
+}
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zswap_debugfs_root;
+
+static int zswap_types_show(struct seq_file *m, void *v)
+{
+	int type;
+
+	seq_printf(m, "%-4s %12s %12s %12s %12s %12s %12s %12s\n",
+		   "type", "stored_pages", "pool_bytes", "stores", "loads",
+		   "rejects", "invalidates", "written_back");
+	for (type = 0; type < MAX_SWAPFILES; type++) {
+		struct zswap_tree *tree = &zswap_trees[type];
+
+		spin_lock(&tree->lock);
+		if (tree->stores || tree->rejects)
+			seq_printf(m, "%-4d %12llu %12llu %12llu %12llu "
+				   "%12llu %12llu %12llu\n", type,
+				   tree->stored_pages, tree->pool_bytes,
+				   tree->stores, tree->loads, tree->rejects,
+				   tree->invalidates, tree->written_back);
+		spin_unlock(&tree->lock);
+	}
+	return 0;
+}
+
+static int zswap_types_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zswap_types_show, NULL);
+}
+
+static const struct file_operations zswap_types_fops = {
+	.open		= zswap_types_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init zswap_debugfs_init(void)
+{
+	if (!debugfs_initialized())
+		return -ENODEV;
+
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			   zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("written_back_pages", S_IRUGO,
+			   zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			   zswap_debugfs_root, &zswap_duplicate_entry);
+	debugfs_create_file("swap_types", S_IRUGO, zswap_debugfs_root,
+			    NULL, &zswap_types_fops);
+	/* atomic_long_t has the layout of a u64 on 64-bit */
+	if (sizeof(atomic_long_t) == sizeof(u64)) {
+		debugfs_create_u64("pool_total_size", S_IRUGO,
+				   zswap_debugfs_root,
+				   (u64 *)&zswap_pool_bytes);
+		debugfs_create_u64("stored_pages", S_IRUGO,
+				   zswap_debugfs_root,
+				   (u64 *)&zswap_stored_pages);
+	}
+	return 0;
+}
+#else
+static int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif /* CONFIG_DEBUG_FS */
+
+static void __init zswap_comp_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (per_cpu(zswap_comp_tfm, cpu))
+			crypto_free_comp(per_cpu(zswap_comp_tfm, cpu));
+		per_cpu(zswap_comp_tfm, cpu) = NULL;
+		kfree(per_cpu(zswap_dstmem, cpu));
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+}
+
+/*
+ * One transform and one bounce buffer per possible cpu, so store and
+ * load only need preemption disabled.
+ */
+static int __init zswap_comp_init(void)
+{
+	struct crypto_comp *tfm;
+	int cpu;
+
+	if (!crypto_has_comp(zswap_compressor, 0, 0)) {
+		printk(KERN_INFO "zswap: compressor %s not available\n",
+		       zswap_compressor);
+		return -ENODEV;
+	}
+
+	for_each_possible_cpu(cpu) {
+		tfm = crypto_alloc_comp(zswap_compressor, 0, 0);
+		if (IS_ERR(tfm))
+			goto fail;
+		per_cpu(zswap_comp_tfm, cpu) = tfm;
+		/* lzo may expand incompressible data past PAGE_SIZE */
+		per_cpu(zswap_dstmem, cpu) = kmalloc_node(PAGE_SIZE * 2,
+						GFP_KERNEL, cpu_to_node(cpu));
+		if (!per_cpu(zswap_dstmem, cpu))
+			goto fail;
+	}
+	return 0;
+
+fail:
+	zswap_comp_exit();
+	return -ENOMEM;
+}
+
+static int __init zswap_init(void)
+{
+	int type;
+
+	for (type = 0; type < MAX_SWAPFILES; type++) {
+		zswap_trees[type].rbroot = RB_ROOT;
+		spin_lock_init(&zswap_trees[type].lock);
+	}
+
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache) {
+		printk(KERN_ERR "zswap: entry cache creation failed\n");
+		return -ENOMEM;
+	}
+
+	if (zswap_comp_init()) {
+		kmem_cache_destroy(zswap_entry_cache);
+		zswap_entry_cache = NULL;
+		return -ENODEV;
+	}
+
+	zswap_debugfs_init();
+	zswap_initialized = 1;
+	printk(KERN_INFO "zswap: using %s compressor\n", zswap_compressor);
+	return 0;
+}
+/* after the crypto algorithms have registered */
+late_initcall(zswap_init);
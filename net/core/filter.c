@@ -89,7 +89,7 @@ int sk_filter(struct sock *sk, struct sk_buff *skb)
 	rcu_read_lock_bh();
 	filter = rcu_dereference_bh(sk->sk_filter);
 	if (filter) {
-		unsigned int pkt_len = sk_run_filter(skb, filter->insns, filter->len);
+		unsigned int pkt_len = SK_RUN_FILTER(filter, skb);
 
 		err = pkt_len ? pskb_trim(skb, pkt_len) : -EPERM;
 	}
@@ -361,6 +361,26 @@ load_b:
 }
 EXPORT_SYMBOL(sk_run_filter);
 
+/**
+ *	__sk_run_filter - interpret the instructions of a struct sk_filter
+ *	@skb: buffer to run the filter on
+ *	@filter: the insns[] array of a struct sk_filter
+ *
+ * This is the &sk_filter->bpf_func of filters the JIT did not translate.
+ * JIT code also hands a packet over to it when it meets a load it does not
+ * resolve inline, so both paths always return the same verdict.
+ */
+unsigned int __sk_run_filter(const struct sk_buff *skb,
+			     const struct sock_filter *filter)
+{
+	const struct sk_filter *fp = container_of(filter, struct sk_filter,
+						  insns[0]);
+
+	return sk_run_filter((struct sk_buff *)skb,
+			     (struct sock_filter *)filter, fp->len);
+}
+EXPORT_SYMBOL(__sk_run_filter);
+
 /**
  *	sk_chk_filter - verify socket filter code
  *	@filter: filter to verify
@@ -631,6 +651,7 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
+	fp->bpf_func = __sk_run_filter;
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (err) {
@@ -638,6 +659,8 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 		return err;
 	}
 
+	bpf_jit_compile(fp);
+
 	old_fp = rcu_dereference_protected(sk->sk_filter,
 					   sock_owned_by_user(sk));
 	rcu_assign_pointer(sk->sk_filter, fp);
@@ -663,3 +686,50 @@ int sk_detach_filter(struct sock *sk)
 	return ret;
 }
 EXPORT_SYMBOL_GPL(sk_detach_filter);
+
+/**
+ *	sk_unattached_filter_create - create a filter not bound to a socket
+ *	@pfp: where to store the new filter
+ *	@fprog: the filter program, in kernel memory
+ *
+ * Checks and, when the JIT is enabled, translates @fprog the same way
+ * sk_attach_filter() does, for in-kernel users that run filters on their
+ * own. Release the filter with sk_unattached_filter_destroy().
+ */
+int sk_unattached_filter_create(struct sk_filter **pfp,
+				struct sock_fprog *fprog)
+{
+	unsigned int fsize = sizeof(struct sock_filter) * fprog->len;
+	struct sk_filter *fp;
+	int err;
+
+	if (fprog->filter == NULL)
+		return -EINVAL;
+
+	fp = kmalloc(fsize + sizeof(*fp), GFP_KERNEL);
+	if (!fp)
+		return -ENOMEM;
+	memcpy(fp->insns, fprog->filter, fsize);
+
+	atomic_set(&fp->refcnt, 1);
+	fp->len = fprog->len;
+	fp->bpf_func = __sk_run_filter;
+
+	err = sk_chk_filter(fp->insns, fp->len);
+	if (err) {
+		kfree(fp);
+		return err;
+	}
+
+	bpf_jit_compile(fp);
+
+	*pfp = fp;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sk_unattached_filter_create);
+
+void sk_unattached_filter_destroy(struct sk_filter *fp)
+{
+	sk_filter_release(fp);
+}
+EXPORT_SYMBOL_GPL(sk_unattached_filter_destroy);
@@ -7,5 +7,15 @@ void netdev_unregister_kobject(struct net_device *);
 #ifdef CONFIG_RPS
 int net_rx_queue_update_kobjects(struct net_device *, int old_num, int new_num);
 #endif
+#ifdef CONFIG_XPS
+int netdev_queue_update_kobjects(struct net_device *net,
+				 int old_num, int new_num);
+#else
+static inline int netdev_queue_update_kobjects(struct net_device *net,
+					       int old_num, int new_num)
+{
+	return 0;
+}
+#endif
 
 #endif
@@ -0,0 +1,369 @@
+/*
+ * Socket filter JIT test
+ *
+ * Runs a set of filters over synthetic packets through the interpreter
+ * and through the code generated by the BPF JIT, checks that both give
+ * the expected verdict and reports how long each path took.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <linux/ktime.h>
+
+static int runs = 100000;
+module_param(runs, int, 0);
+MODULE_PARM_DESC(runs, "Number of times each filter is timed per path");
+
+/* Ethernet + IPv4 + TCP to port 22, with some payload */
+static const u8 tcp_packet[] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55,	/* destination MAC */
+	0x00, 0x66, 0x77, 0x88, 0x99, 0xaa,	/* source MAC */
+	0x08, 0x00,				/* ETH_P_IP */
+	0x45, 0x00, 0x00, 0x48,			/* IPv4, ihl 5, tot_len 72 */
+	0x12, 0x34, 0x40, 0x00,			/* id, DF */
+	0x40, 0x06, 0x00, 0x00,			/* ttl 64, TCP, check */
+	0x0a, 0x00, 0x00, 0x01,			/* 10.0.0.1 */
+	0x0a, 0x00, 0x00, 0x02,			/* 10.0.0.2 */
+	0x04, 0xd2, 0x00, 0x16,			/* 1234 -> 22 */
+	0x00, 0x00, 0x00, 0x01,			/* seq */
+	0x00, 0x00, 0x00, 0x00,			/* ack_seq */
+	0x50, 0x02, 0x16, 0xd0,			/* doff 5, SYN, window */
+	0x00, 0x00, 0x00, 0x00,			/* check, urg_ptr */
+	0xde, 0xad, 0xbe, 0xef, 0x01, 0x02, 0x03, 0x04,
+	0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c,
+	0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14,
+	0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c,
+};
+
+#define ETH_IP_HLEN	(ETH_HLEN + 20)
+
+enum {
+	SKB_LINEAR,	/* whole packet in the linear area */
+	SKB_PAGED,	/* only the Ethernet and IP headers are linear */
+	SKB_SHORT,	/* truncated after the IP addresses */
+	SKB_MAX,
+};
+
+static const char * const skb_names[SKB_MAX] = {
+	"linear", "paged", "short",
+};
+
+/* tcpdump -dd "tcp port 22" */
+static struct sock_filter tcp_port_22[] = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x86dd, 0, 6),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x6, 0, 15),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 54),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x16, 12, 0),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 56),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x16, 10, 11),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x800, 0, 10),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x6, 0, 8),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 6, 0),
+	BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 14),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x16, 2, 0),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 16),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x16, 0, 1),
+	BPF_STMT(BPF_RET|BPF_K, 0xffff),
+	BPF_STMT(BPF_RET|BPF_K, 0),
+};
+
+/* every ALU operation, with constant and X operands */
+static struct sock_filter alu[] = {
+	BPF_STMT(BPF_LD|BPF_IMM, 0x12345678),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 1000),
+	BPF_STMT(BPF_ALU|BPF_SUB|BPF_K, 0x10),
+	BPF_STMT(BPF_ALU|BPF_MUL|BPF_K, 7),
+	BPF_STMT(BPF_ALU|BPF_DIV|BPF_K, 3),
+	BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xffff0fff),
+	BPF_STMT(BPF_ALU|BPF_OR|BPF_K, 0x80),
+	BPF_STMT(BPF_ALU|BPF_LSH|BPF_K, 3),
+	BPF_STMT(BPF_ALU|BPF_RSH|BPF_K, 1),
+	BPF_STMT(BPF_ALU|BPF_NEG, 0),
+	BPF_STMT(BPF_MISC|BPF_TAX, 0),
+	BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_ALU|BPF_MUL|BPF_X, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 5),
+	BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+	BPF_STMT(BPF_ALU|BPF_SUB|BPF_X, 0),
+	BPF_STMT(BPF_ALU|BPF_OR|BPF_X, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 4),
+	BPF_STMT(BPF_ALU|BPF_LSH|BPF_X, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 9),
+	BPF_STMT(BPF_ALU|BPF_RSH|BPF_X, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 0xfffffeff),
+	BPF_STMT(BPF_ALU|BPF_AND|BPF_X, 0),
+	BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xffffff3f),
+	BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xffff7fff),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+/* scratch memory, first and last words */
+static struct sock_filter scratch[] = {
+	BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 3),
+	BPF_STMT(BPF_STX, 15),
+	BPF_STMT(BPF_LD|BPF_MEM, 15),
+	BPF_STMT(BPF_LDX|BPF_MEM, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+/* A / 0 drops the packet */
+static struct sock_filter div_zero[] = {
+	BPF_STMT(BPF_LDX|BPF_IMM, 0),
+	BPF_STMT(BPF_LD|BPF_IMM, 10),
+	BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_K, 1),
+};
+
+/* every conditional jump, taken and not taken; returns 1 when all agree */
+static struct sock_filter jumps[] = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x800, 0, 17),
+	BPF_JUMP(BPF_JMP|BPF_JGT|BPF_K, 0x7ff, 0, 16),
+	BPF_JUMP(BPF_JMP|BPF_JGT|BPF_K, 0x800, 15, 0),
+	BPF_JUMP(BPF_JMP|BPF_JGE|BPF_K, 0x800, 0, 14),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x800, 0, 13),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x10000, 12, 0),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x8, 11, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 0x800),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_X, 0, 0, 9),
+	BPF_JUMP(BPF_JMP|BPF_JGT|BPF_X, 0, 8, 0),
+	BPF_JUMP(BPF_JMP|BPF_JGE|BPF_X, 0, 0, 7),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_X, 0, 0, 6),
+	BPF_STMT(BPF_LDX|BPF_IMM, 0x1000),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_X, 0, 4, 0),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 3, 0),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x800, 1, 1),
+	BPF_STMT(BPF_RET|BPF_K, 2),
+	BPF_STMT(BPF_JMP|BPF_JA, 1),
+	BPF_STMT(BPF_RET|BPF_K, 0),
+	BPF_STMT(BPF_RET|BPF_K, 1),
+};
+
+#define ADD_1000	BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 1000)
+#define ADD_1000_X8	ADD_1000, ADD_1000, ADD_1000, ADD_1000, \
+			ADD_1000, ADD_1000, ADD_1000, ADD_1000
+
+/* branches over more than 127 bytes of code need 32 bit offsets */
+static struct sock_filter far_jumps[] = {
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 6, 0, 40),
+	ADD_1000_X8, ADD_1000_X8, ADD_1000_X8, ADD_1000_X8, ADD_1000_X8,
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+/* word, half and byte loads, some of them across the linear area */
+static struct sock_filter loads[] = {
+	BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 26),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 32),
+	BPF_STMT(BPF_LDX|BPF_MEM, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 14),
+	BPF_STMT(BPF_MISC|BPF_TAX, 0),
+	BPF_STMT(BPF_LD|BPF_W|BPF_IND, 1),
+	BPF_STMT(BPF_LDX|BPF_MEM, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 70),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 14),
+	BPF_STMT(BPF_LDX|BPF_MEM, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 85),
+	BPF_STMT(BPF_LDX|BPF_MEM, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+/* loads past the end of the packet drop it */
+static struct sock_filter out_of_range[] = {
+	BPF_STMT(BPF_LDX|BPF_IMM, 0x10000),
+	BPF_STMT(BPF_LD|BPF_B|BPF_IND, 0),
+	BPF_STMT(BPF_RET|BPF_K, 1),
+};
+
+/* negative indirect offsets are resolved by the interpreter */
+static struct sock_filter net_off[] = {
+	BPF_STMT(BPF_LDX|BPF_IMM, 0),
+	BPF_STMT(BPF_LD|BPF_B|BPF_IND, SKF_NET_OFF + 9),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+/* ancillary data is not translated, the filter stays on the interpreter */
+static struct sock_filter ancillary[] = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+struct bpf_test {
+	const char		*name;
+	struct sock_filter	*insns;
+	unsigned short		len;
+	unsigned int		result[SKB_MAX];
+};
+
+#define BPF_TEST(prog, linear, paged, shrt)				\
+	{ #prog, prog, ARRAY_SIZE(prog), { linear, paged, shrt } }
+
+static struct bpf_test tests[] = {
+	BPF_TEST(tcp_port_22, 0xffff, 0xffff, 0),
+	BPF_TEST(alu, 0x542823, 0x542823, 0xc6638),
+	BPF_TEST(scratch, 89, 89, 37),
+	BPF_TEST(div_zero, 0, 0, 0),
+	BPF_TEST(jumps, 1, 1, 1),
+	BPF_TEST(far_jumps, 40006, 40006, 40006),
+	BPF_TEST(loads, 0x17102f1b, 0x17102f1b, 0),
+	BPF_TEST(out_of_range, 0, 0, 0),
+	BPF_TEST(net_off, 6, 6, 6),
+	BPF_TEST(ancillary, ETH_P_IP, ETH_P_IP, ETH_P_IP),
+};
+
+static struct sk_buff *build_skb(int type)
+{
+	unsigned int len = sizeof(tcp_packet);
+	unsigned int head = len;
+	struct sk_buff *skb;
+	struct page *page;
+
+	if (type == SKB_PAGED)
+		head = ETH_IP_HLEN;
+	else if (type == SKB_SHORT)
+		head = len = ETH_IP_HLEN;
+
+	skb = alloc_skb(NET_IP_ALIGN + head, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	skb_reserve(skb, NET_IP_ALIGN);
+	memcpy(skb_put(skb, head), tcp_packet, head);
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb->protocol = htons(ETH_P_IP);
+
+	if (len > head) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		memcpy(page_address(page), tcp_packet + head, len - head);
+		skb_fill_page_desc(skb, 0, page, 0, len - head);
+		skb->len += len - head;
+		skb->data_len += len - head;
+		skb->truesize += PAGE_SIZE;
+	}
+	return skb;
+}
+
+static u64 time_filter(struct sk_filter *fp, struct sk_buff *skb, bool jit)
+{
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < runs; i++) {
+		if (jit)
+			SK_RUN_FILTER(fp, skb);
+		else
+			sk_run_filter(skb, fp->insns, fp->len);
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int run_test(struct bpf_test *test, struct sk_buff **skbs)
+{
+	struct sock_fprog fprog = {
+		.len	= test->len,
+		.filter	= test->insns,
+	};
+	struct sk_filter *fp;
+	unsigned int interp, native;
+	bool jited;
+	u64 ns_interp, ns_jit;
+	int i, err, failed = 0;
+
+	err = sk_unattached_filter_create(&fp, &fprog);
+	if (err) {
+		pr_err("test_bpf: %s: filter rejected (%d)\n", test->name, err);
+		return 1;
+	}
+	jited = fp->bpf_func != __sk_run_filter;
+
+	for (i = 0; i < SKB_MAX; i++) {
+		interp = sk_run_filter(skbs[i], fp->insns, fp->len);
+		native = SK_RUN_FILTER(fp, skbs[i]);
+		if (interp != test->result[i] || native != interp) {
+			pr_err("test_bpf: %s on %s skb: interpreter %#x, %s %#x, expected %#x\n",
+			       test->name, skb_names[i], interp,
+			       jited ? "jit" : "bpf_func", native,
+			       test->result[i]);
+			failed = 1;
+		}
+	}
+
+	if (runs > 0) {
+		ns_interp = time_filter(fp, skbs[SKB_LINEAR], false);
+		ns_jit = time_filter(fp, skbs[SKB_LINEAR], true);
+		pr_info("test_bpf: %-12s %s interpreter %llu ns/run, %s %llu ns/run\n",
+			test->name, failed ? "FAIL" : "ok  ",
+			div_u64(ns_interp, runs),
+			jited ? "jit" : "not jited,",
+			div_u64(ns_jit, runs));
+	}
+
+	sk_unattached_filter_destroy(fp);
+	return failed;
+}
+
+static int __init test_bpf_init(void)
+{
+	struct sk_buff *skbs[SKB_MAX] = { NULL, };
+	int i, failed = 0, err = 0;
+
+	for (i = 0; i < SKB_MAX; i++) {
+		skbs[i] = build_skb(i);
+		if (!skbs[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++)
+		failed += run_test(&tests[i], skbs);
+
+	pr_info("test_bpf: %d of %zu tests failed\n", failed,
+		ARRAY_SIZE(tests));
+	if (failed)
+		err = -EINVAL;
+out:
+	for (i = 0; i < SKB_MAX; i++)
+		kfree_skb(skbs[i]);
+	return err;
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+MODULE_LICENSE("GPL");
@@ -513,6 +513,22 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * MAY_EXEC check on a directory during path walk.  @rcu is set when the
+ * caller is in RCU path walk and holds no reference on @inode; only the
+ * default hooks are known not to sleep or touch security blobs that are
+ * freed synchronously, so any other module makes the walk fall back to
+ * taking references.
+ */
+int security_inode_exec_permission(struct inode *inode, int rcu)
+{
+	if (unlikely(IS_PRIVATE(inode)))
+		return 0;
+	if (rcu && security_ops != &default_security_ops)
+		return -ECHILD;
+	return security_ops->inode_permission(inode, MAY_EXEC);
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
@@ -0,0 +1,356 @@
+/*
+ *
+ * epoll-wakeup.c
+ *
+ * wakeup: Benchmark for epoll event dispatch to a pool of threads
+ *
+ * A pool of threads waits in epoll_wait() for events on one shared
+ * file, and the main thread generates events one at a time and waits
+ * until a worker has consumed each. Three setups are compared:
+ *
+ *  shared:     all threads wait on a single epoll instance
+ *  per-thread: every thread has its own epoll instance
+ *  exclusive:  per-thread instances, file added with EPOLLEXCLUSIVE
+ *
+ * For each setup the dispatch latency (event generated to event
+ * consumed) and the number of times the workers were woken up per
+ * event are reported. A wakeup whose event was already taken by
+ * another thread is mostly invisible to userspace, epoll_wait() just
+ * goes back to sleep, so wakeups are counted as voluntary context
+ * switches of the workers.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef RUSAGE_THREAD
+# define RUSAGE_THREAD 1
+#endif
+
+#ifndef EPOLLEXCLUSIVE
+# define EPOLLEXCLUSIVE (1U << 28)
+#endif
+
+static int nr_threads = 32;
+static int nr_events = 20000;
+static bool use_accept;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of waiting threads"),
+	OPT_INTEGER('n', "events", &nr_events,
+		    "Specify number of events to dispatch"),
+	OPT_BOOLEAN('a', "accept", &use_accept,
+		    "Dispatch connections on a listening socket "
+		    "instead of pipe reads"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wakeup_usage[] = {
+	"perf bench epoll wakeup <options>",
+	NULL
+};
+
+enum setup {
+	SETUP_SHARED,
+	SETUP_PER_THREAD,
+	SETUP_EXCLUSIVE,
+	NR_SETUPS
+};
+
+static const char * const setup_names[NR_SETUPS] = {
+	"shared",
+	"per-thread",
+	"exclusive",
+};
+
+struct result {
+	unsigned long long	total_usec;	/* sum of dispatch latencies */
+	unsigned long long	max_usec;
+	unsigned long		wakeups;	/* times the workers slept */
+};
+
+/* file the events show up on: pipe read end or listening socket */
+static int event_fd;
+/* pipe write end, or the address to connect to */
+static int pipe_wfd;
+static struct sockaddr_in listen_addr;
+/* readable once to make every worker leave */
+static int quit_fds[2];
+/* a worker reports each consumed event here */
+static int done_fds[2];
+
+static struct timeval event_stamp;
+static unsigned long nr_wakeups;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void set_nonblock(int fd)
+{
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+		barf("fcntl()");
+}
+
+static void epoll_add(int epfd, int fd, unsigned int events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+		barf("epoll_ctl()");
+}
+
+static void setup_event_source(void)
+{
+	int fds[2];
+
+	if (!use_accept) {
+		if (pipe(fds))
+			barf("pipe()");
+		event_fd = fds[0];
+		pipe_wfd = fds[1];
+	} else {
+		socklen_t len = sizeof(listen_addr);
+		int one = 1;
+
+		event_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (event_fd < 0)
+			barf("socket()");
+		setsockopt(event_fd, SOL_SOCKET, SO_REUSEADDR,
+			   &one, sizeof(one));
+		memset(&listen_addr, 0, sizeof(listen_addr));
+		listen_addr.sin_family = AF_INET;
+		listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(event_fd, (struct sockaddr *)&listen_addr,
+			 sizeof(listen_addr)))
+			barf("bind()");
+		if (getsockname(event_fd, (struct sockaddr *)&listen_addr,
+				&len))
+			barf("getsockname()");
+		if (listen(event_fd, 128))
+			barf("listen()");
+	}
+	/* workers race for each event, the losers must not block */
+	set_nonblock(event_fd);
+}
+
+/* Returns 1 if an event was consumed, 0 if another worker got it */
+static int consume_event(void)
+{
+	char c;
+	int fd;
+
+	if (!use_accept)
+		return read(event_fd, &c, 1) == 1;
+
+	fd = accept(event_fd, NULL, NULL);
+	if (fd < 0)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+/* Generate one event, returns the client socket to close afterwards */
+static int generate_event(void)
+{
+	int fd;
+
+	gettimeofday(&event_stamp, NULL);
+	if (!use_accept) {
+		if (write(pipe_wfd, "e", 1) != 1)
+			barf("write()");
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		barf("socket()");
+	if (connect(fd, (struct sockaddr *)&listen_addr, sizeof(listen_addr)))
+		barf("connect()");
+	return fd;
+}
+
+static void *worker(void *arg)
+{
+	int epfd = (long)arg;
+	struct epoll_event evs[2];
+	struct timeval now, diff;
+	struct rusage ru;
+	unsigned long long usec;
+	int i, n, quit = 0;
+
+	while (!quit) {
+		n = epoll_wait(epfd, evs, 2, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			barf("epoll_wait()");
+		}
+		for (i = 0; i < n; i++) {
+			if (evs[i].data.fd == quit_fds[0]) {
+				quit = 1;
+				continue;
+			}
+			/* lost the race to another worker */
+			if (!consume_event())
+				continue;
+			gettimeofday(&now, NULL);
+			timersub(&now, &event_stamp, &diff);
+			usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+			if (write(done_fds[1], &usec, sizeof(usec)) !=
+			    sizeof(usec))
+				barf("write()");
+		}
+	}
+
+	if (getrusage(RUSAGE_THREAD, &ru))
+		barf("getrusage()");
+	pthread_mutex_lock(&stats_lock);
+	nr_wakeups += ru.ru_nvcsw;
+	pthread_mutex_unlock(&stats_lock);
+	return NULL;
+}
+
+static void run_setup(enum setup setup, struct result *res)
+{
+	pthread_t *threads;
+	int *epfds;
+	unsigned long long usec;
+	int i, nr_epfds, fd;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	epfds = calloc(nr_threads, sizeof(*epfds));
+	if (!threads || !epfds)
+		barf("calloc()");
+
+	if (pipe(quit_fds) || pipe(done_fds))
+		barf("pipe()");
+	nr_wakeups = 0;
+
+	nr_epfds = setup == SETUP_SHARED ? 1 : nr_threads;
+	for (i = 0; i < nr_epfds; i++) {
+		epfds[i] = epoll_create(1);
+		if (epfds[i] < 0)
+			barf("epoll_create()");
+		epoll_add(epfds[i], event_fd, setup == SETUP_EXCLUSIVE ?
+			  EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN);
+		epoll_add(epfds[i], quit_fds[0], EPOLLIN);
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		long epfd = epfds[setup == SETUP_SHARED ? 0 : i];
+
+		if (pthread_create(&threads[i], NULL, worker, (void *)epfd))
+			barf("pthread_create()");
+	}
+	/* let every worker block in epoll_wait() */
+	usleep(100000);
+
+	memset(res, 0, sizeof(*res));
+	for (i = 0; i < nr_events; i++) {
+		fd = generate_event();
+		if (read(done_fds[0], &usec, sizeof(usec)) != sizeof(usec))
+			barf("read()");
+		if (fd >= 0)
+			close(fd);
+		res->total_usec += usec;
+		if (usec > res->max_usec)
+			res->max_usec = usec;
+	}
+
+	if (write(quit_fds[1], "q", 1) != 1)
+		barf("write()");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	/* the final wakeup to quit is not part of the dispatch */
+	res->wakeups = nr_wakeups - nr_threads;
+
+	for (i = 0; i < nr_epfds; i++)
+		close(epfds[i]);
+	close(quit_fds[0]);
+	close(quit_fds[1]);
+	close(done_fds[0]);
+	close(done_fds[1]);
+	free(epfds);
+	free(threads);
+}
+
+int bench_epoll_wakeup(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct result res[NR_SETUPS];
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_wakeup_usage, 0);
+
+	if (nr_threads < 1 || nr_events < 1) {
+		fprintf(stderr, "threads and events must be positive\n");
+		return 1;
+	}
+
+	setup_event_source();
+	for (i = 0; i < NR_SETUPS; i++)
+		run_setup(i, &res[i]);
+	close(event_fd);
+	if (!use_accept)
+		close(pipe_wfd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Dispatching %d %s events to %d threads\n\n",
+		       nr_events, use_accept ? "accept" : "read",
+		       nr_threads);
+		printf(" %12s %14s %14s %18s\n", "setup", "avg [usec]",
+		       "max [usec]", "wakeups/event");
+		for (i = 0; i < NR_SETUPS; i++)
+			printf(" %12s %14.2lf %14llu %18.2lf\n",
+			       setup_names[i],
+			       (double)res[i].total_usec / nr_events,
+			       res[i].max_usec,
+			       (double)res[i].wakeups / nr_events);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		for (i = 0; i < NR_SETUPS; i++)
+			printf("%.2lf %lu%s",
+			       (double)res[i].total_usec / nr_events,
+			       res[i].wakeups,
+			       i == NR_SETUPS - 1 ? "\n" : " ");
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
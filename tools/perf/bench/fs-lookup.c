@@ -0,0 +1,187 @@
+/*
+ *
+ * fs-lookup.c
+ *
+ * lookup: Benchmark for pathname lookup scalability
+ *
+ * Threads stat() the same cached, multi-component path in a loop, so
+ * the dcache fast path and its shared cache lines dominate the cost.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char *base_dir = "/tmp";
+static int nr_threads = 1;
+static int depth = 4;
+static int loops = 1000000;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &base_dir, "dir",
+		   "Directory to create the lookup tree in"),
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads"),
+	OPT_INTEGER('D', "depth", &depth,
+		    "Specify number of path components"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of lookups per thread"),
+	OPT_END()
+};
+
+static const char * const bench_fs_lookup_usage[] = {
+	"perf bench fs lookup <options>",
+	NULL
+};
+
+static char path[PATH_MAX];
+static pthread_mutex_t start_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void *worker(void *arg __used)
+{
+	struct stat st;
+	int i;
+
+	/* wait for the main thread to start the clock */
+	pthread_mutex_lock(&start_mutex);
+	pthread_mutex_unlock(&start_mutex);
+
+	for (i = 0; i < loops; i++) {
+		if (stat(path, &st))
+			barf("stat()");
+	}
+	return NULL;
+}
+
+/* Build base_dir/perf-lookup.<pid>/d/d/.../f, leaving its name in path */
+static void create_tree(void)
+{
+	int len, i, fd;
+
+	len = snprintf(path, sizeof(path), "%s/perf-lookup.%d",
+		       base_dir, getpid());
+	if (mkdir(path, 0700))
+		barf("mkdir()");
+	for (i = 1; i < depth; i++) {
+		len += snprintf(path + len, sizeof(path) - len, "/d");
+		if (mkdir(path, 0700))
+			barf("mkdir()");
+	}
+	snprintf(path + len, sizeof(path) - len, "/f");
+	fd = open(path, O_CREAT | O_WRONLY, 0600);
+	if (fd < 0)
+		barf("open()");
+	close(fd);
+}
+
+static void remove_tree(void)
+{
+	int i;
+
+	if (unlink(path))
+		return;
+	/* the file, then depth directories back up to perf-lookup.<pid> */
+	for (i = 0; i < depth; i++) {
+		*strrchr(path, '/') = '\0';
+		if (rmdir(path))
+			return;
+	}
+}
+
+int bench_fs_lookup(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	pthread_t *threads;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_lookup_usage, 0);
+
+	if (nr_threads < 1 || depth < 1 || loops < 1) {
+		fprintf(stderr, "threads, depth and loops must be positive\n");
+		return 1;
+	}
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		barf("calloc()");
+
+	create_tree();
+
+	pthread_mutex_lock(&start_mutex);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL))
+			barf("pthread_create()");
+	}
+	gettimeofday(&start, NULL);
+	pthread_mutex_unlock(&start_mutex);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	remove_tree();
+	free(threads);
+
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	total = (unsigned long long)loops * nr_threads;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads stat()ing a %d component path, "
+		       "%d times each\n\n", nr_threads, depth, loops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec * nr_threads / (double)total);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14llu ops/sec/thread\n",
+		       (unsigned long long)((double)loops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
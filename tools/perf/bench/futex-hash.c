@@ -0,0 +1,173 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for futex hash bucket contention
+ *
+ * Every thread owns a set of private futexes and keeps calling
+ * FUTEX_WAIT on them with a value that does not match, so each call
+ * hashes the futex, takes and drops the bucket lock, and returns
+ * EAGAIN at once.  Threads never share a futex: whatever limits the
+ * throughput as threads are added is unrelated futexes colliding on
+ * the same bucket.  The run is repeated with 1, 2, 4, ... threads up
+ * to the number asked for.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static int nr_threads;
+static int nr_futexes = 1024;
+static int runtime = 1;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify maximum number of threads (default: online cpus)"),
+	OPT_INTEGER('f', "futexes", &nr_futexes,
+		    "Specify number of futexes per thread"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime per thread count, in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t		thread;
+	u_int32_t		*futexes;
+	unsigned long long	ops;
+};
+
+static volatile int done;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long ops = 0;
+	int i;
+
+	while (!done) {
+		for (i = 0; i < nr_futexes; i++) {
+			/* the futex holds 0: this never sleeps */
+			futex_wait(&w->futexes[i], 1234);
+			ops++;
+		}
+	}
+	w->ops = ops;
+	return NULL;
+}
+
+/* Returns the operations per second with @threads threads */
+static double run(int threads)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long long ops = 0;
+	double secs;
+	int i;
+
+	workers = calloc(threads, sizeof(*workers));
+	if (!workers)
+		barf("calloc()");
+
+	done = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < threads; i++) {
+		workers[i].futexes = calloc(nr_futexes, sizeof(u_int32_t));
+		if (!workers[i].futexes)
+			barf("calloc()");
+		if (pthread_create(&workers[i].thread, NULL, worker,
+				   &workers[i]))
+			barf("pthread_create()");
+	}
+
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+		free(workers[i].futexes);
+	}
+	gettimeofday(&stop, NULL);
+	free(workers);
+
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	return ops / secs;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	double ops;
+	int threads;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads < 1 || nr_futexes < 1 || runtime < 1) {
+		fprintf(stderr, "threads, futexes and runtime must be "
+			"positive\n");
+		return 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT) {
+		printf("# %d private futexes per thread, %d sec per run\n\n",
+		       nr_futexes, runtime);
+		printf(" %8s %16s %16s\n", "threads", "ops/sec",
+		       "ops/sec/thread");
+	}
+
+	for (threads = 1; ; threads *= 2) {
+		if (threads > nr_threads)
+			threads = nr_threads;
+		ops = run(threads);
+
+		switch (bench_format) {
+		case BENCH_FORMAT_DEFAULT:
+			printf(" %8d %16.0lf %16.0lf\n", threads, ops,
+			       ops / threads);
+			break;
+
+		case BENCH_FORMAT_SIMPLE:
+			printf("%d %.0lf\n", threads, ops);
+			break;
+
+		default:
+			/* reaching here is something disaster */
+			fprintf(stderr, "Unknown format:%d\n", bench_format);
+			exit(1);
+			break;
+		}
+
+		if (threads == nr_threads)
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ *
+ * futex-requeue.c
+ *
+ * requeue: Benchmark for requeueing waiters between futexes
+ *
+ * A number of threads block in FUTEX_WAIT on one futex, and the main
+ * thread moves them to a second futex with FUTEX_CMP_REQUEUE, waking
+ * none and requeueing one per call, as pthread_cond_broadcast() does
+ * when it hands the waiters over to the mutex.  The time to requeue
+ * them all is measured, with 1, 2, 4, ... waiters up to the number
+ * asked for, and averaged over several rounds.  Requeueing holds both
+ * bucket locks, so it also shows collisions between the two futexes'
+ * buckets and others.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static int nr_threads;
+static int nr_rounds = 10;
+static int nr_requeue = 1;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify maximum number of waiters (default: online cpus)"),
+	OPT_INTEGER('r', "rounds", &nr_rounds,
+		    "Specify number of rounds per waiter count"),
+	OPT_INTEGER('q', "nrequeue", &nr_requeue,
+		    "Specify number of waiters to requeue per call"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static u_int32_t futex1, futex2;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void *waiter(void *arg __used)
+{
+	/* woken, from futex2, only at the end of the round */
+	while (futex_wait(&futex1, 0) && errno == EINTR)
+		;
+	return NULL;
+}
+
+/* Returns the usecs it took to requeue @threads waiters */
+static unsigned long long run(int threads)
+{
+	pthread_t *waiters;
+	struct timeval start, stop, diff;
+	int i, ret, requeued = 0;
+
+	waiters = calloc(threads, sizeof(*waiters));
+	if (!waiters)
+		barf("calloc()");
+
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&waiters[i], NULL, waiter, NULL))
+			barf("pthread_create()");
+	/* let every waiter block in FUTEX_WAIT */
+	usleep(100000);
+
+	gettimeofday(&start, NULL);
+	while (requeued < threads) {
+		ret = futex_cmp_requeue(&futex1, 0, &futex2, 0, nr_requeue);
+		if (ret < 0)
+			barf("futex_cmp_requeue()");
+		requeued += ret;
+	}
+	gettimeofday(&stop, NULL);
+
+	for (i = 0; i < threads; )
+		i += futex_wake(&futex2, threads);
+	for (i = 0; i < threads; i++)
+		pthread_join(waiters[i], NULL);
+	free(waiters);
+
+	timersub(&stop, &start, &diff);
+	return diff.tv_sec * 1000000ULL + diff.tv_usec;
+}
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	unsigned long long usec;
+	int threads, round;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads < 1 || nr_rounds < 1 || nr_requeue < 1) {
+		fprintf(stderr, "threads, rounds and nrequeue must be "
+			"positive\n");
+		return 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT) {
+		printf("# Requeueing the waiters of one futex, %d per call, "
+		       "%d rounds\n\n", nr_requeue, nr_rounds);
+		printf(" %8s %16s %16s\n", "waiters", "usecs/round",
+		       "usecs/waiter");
+	}
+
+	for (threads = 1; ; threads *= 2) {
+		if (threads > nr_threads)
+			threads = nr_threads;
+		usec = 0;
+		for (round = 0; round < nr_rounds; round++)
+			usec += run(threads);
+
+		switch (bench_format) {
+		case BENCH_FORMAT_DEFAULT:
+			printf(" %8d %16.2lf %16.2lf\n", threads,
+			       (double)usec / nr_rounds,
+			       (double)usec / nr_rounds / threads);
+			break;
+
+		case BENCH_FORMAT_SIMPLE:
+			printf("%d %.2lf\n", threads,
+			       (double)usec / nr_rounds);
+			break;
+
+		default:
+			/* reaching here is something disaster */
+			fprintf(stderr, "Unknown format:%d\n", bench_format);
+			exit(1);
+			break;
+		}
+
+		if (threads == nr_threads)
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Glue for the futex benchmarks: raw futex(2) calls, glibc has no wrapper.
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+#ifndef FUTEX_PRIVATE_FLAG
+# define FUTEX_PRIVATE_FLAG	128
+#endif
+
+static inline int
+futex(u_int32_t *uaddr, int op, u_int32_t val, struct timespec *timeout,
+      u_int32_t *uaddr2, u_int32_t val3)
+{
+	return syscall(SYS_futex, uaddr, op | FUTEX_PRIVATE_FLAG, val,
+		       timeout, uaddr2, val3);
+}
+
+/* Sleep while *uaddr == val */
+static inline int futex_wait(u_int32_t *uaddr, u_int32_t val)
+{
+	return futex(uaddr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+/* Wake up to nr_wake waiters on uaddr, returns how many were woken */
+static inline int futex_wake(u_int32_t *uaddr, int nr_wake)
+{
+	return futex(uaddr, FUTEX_WAKE, nr_wake, NULL, NULL, 0);
+}
+
+/*
+ * Wake nr_wake waiters on uaddr and move up to nr_requeue more to uaddr2,
+ * if *uaddr is still val.  Returns the number woken plus requeued.
+ */
+static inline int futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val,
+				    u_int32_t *uaddr2, int nr_wake,
+				    int nr_requeue)
+{
+	return futex(uaddr, FUTEX_CMP_REQUEUE, nr_wake,
+		     (struct timespec *)(long)nr_requeue, uaddr2, val);
+}
+
+#endif /* _FUTEX_H */
@@ -0,0 +1,215 @@
+/*
+ *
+ * mem-reclaim.c
+ *
+ * reclaim: Benchmark for page reclaim under a mixed workload
+ *
+ * A hot anonymous working set is touched continuously while a cold
+ * file-backed set, meant to be larger than free memory, is streamed
+ * through with mmap().  Reclaim has to evict the cold pages and keep the
+ * hot ones; the elapsed time, the major faults taken on the hot set and
+ * the reclaim counters from /proc/vmstat show how well it did.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static const char *hot_str = "256MB";
+static const char *cold_str = "2GB";
+static const char *base_dir = "/var/tmp";
+static int passes = 4;
+static int ratio = 4;
+
+static const struct option options[] = {
+	OPT_STRING('H', "hot", &hot_str, "256MB",
+		   "Size of the anonymous working set that is kept in use"),
+	OPT_STRING('C', "cold", &cold_str, "2GB",
+		   "Size of the file streamed through once per pass"),
+	OPT_STRING('d', "dir", &base_dir, "dir",
+		   "Directory to create the cold file in (not tmpfs)"),
+	OPT_INTEGER('p', "passes", &passes,
+		    "Specify number of passes over the cold file"),
+	OPT_INTEGER('r', "ratio", &ratio,
+		    "Touch a hot page every this many cold pages"),
+	OPT_END()
+};
+
+static const char * const bench_mem_reclaim_usage[] = {
+	"perf bench mem reclaim <options>",
+	NULL
+};
+
+/* /proc/vmstat counters reported, summed over all lines with the prefix */
+static const char * const vmstat_names[] = {
+	"pgscan_kswapd",
+	"pgscan_direct",
+	"pgsteal",
+	"pgrefill",
+	"pgactivate",
+	"pgdeactivate",
+	"pswpin",
+	"pswpout",
+	"lru_gen_aging",
+	"lru_gen_mm_walk",
+	"lru_gen_young_ptes",
+	NULL
+};
+
+#define NR_VMSTAT	(sizeof(vmstat_names) / sizeof(vmstat_names[0]) - 1)
+
+static char path[PATH_MAX];
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	char name[64];
+	unsigned long long val;
+	FILE *fp;
+	unsigned int i;
+
+	memset(vals, 0, NR_VMSTAT * sizeof(*vals));
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		barf("fopen(/proc/vmstat)");
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		for (i = 0; i < NR_VMSTAT; i++) {
+			if (!strncmp(name, vmstat_names[i],
+				     strlen(vmstat_names[i])))
+				vals[i] += val;
+		}
+	}
+	fclose(fp);
+}
+
+int bench_mem_reclaim(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	unsigned long long before[NR_VMSTAT], after[NR_VMSTAT];
+	struct timeval start, stop, diff;
+	struct rusage ru_start, ru_stop;
+	size_t hot_len, cold_len, hot_pages, cold_pages, page_size;
+	size_t i, hot_idx = 0;
+	volatile char *hot, *cold;
+	unsigned long sum = 0;
+	unsigned int j;
+	int fd, pass;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_reclaim_usage, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	hot_len = (size_t)perf_atoll((char *)hot_str);
+	cold_len = (size_t)perf_atoll((char *)cold_str);
+	if ((s64)hot_len <= 0 || (s64)cold_len <= 0) {
+		fprintf(stderr, "Invalid size: hot %s cold %s\n",
+			hot_str, cold_str);
+		return 1;
+	}
+	if (passes < 1 || ratio < 1) {
+		fprintf(stderr, "passes and ratio must be positive\n");
+		return 1;
+	}
+	hot_pages = hot_len / page_size;
+	cold_pages = cold_len / page_size;
+
+	hot = mmap(NULL, hot_len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (hot == MAP_FAILED)
+		barf("mmap(hot)");
+	for (i = 0; i < hot_pages; i++)
+		hot[i * page_size] = 1;
+
+	/* a sparse file: reading it fills the page cache without disk I/O */
+	snprintf(path, sizeof(path), "%s/perf-reclaim.%d", base_dir, getpid());
+	fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if (fd < 0)
+		barf("open()");
+	unlink(path);
+	if (ftruncate(fd, cold_len))
+		barf("ftruncate()");
+	cold = mmap(NULL, cold_len, PROT_READ, MAP_SHARED, fd, 0);
+	if (cold == MAP_FAILED)
+		barf("mmap(cold)");
+
+	read_vmstat(before);
+	getrusage(RUSAGE_SELF, &ru_start);
+	gettimeofday(&start, NULL);
+
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < cold_pages; i++) {
+			sum += cold[i * page_size];
+			if (i % ratio)
+				continue;
+			hot[hot_idx * page_size]++;
+			if (++hot_idx == hot_pages)
+				hot_idx = 0;
+		}
+	}
+
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &ru_stop);
+	read_vmstat(after);
+	timersub(&stop, &start, &diff);
+
+	munmap((void *)cold, cold_len);
+	munmap((void *)hot, hot_len);
+	close(fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %s hot anon set, %s cold file set, %d passes, "
+		       "1 hot touch per %d cold pages\n\n",
+		       hot_str, cold_str, passes, ratio);
+
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+		printf(" %14s: %lu\n\n", "Major faults",
+		       ru_stop.ru_majflt - ru_start.ru_majflt);
+
+		for (j = 0; j < NR_VMSTAT; j++)
+			printf(" %20s: %llu\n", vmstat_names[j],
+			       after[j] - before[j]);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	/* keep the cold reads from being optimized away */
+	if (sum == ~0UL)
+		printf("\n");
+
+	return 0;
+}
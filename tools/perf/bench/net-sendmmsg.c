@@ -0,0 +1,222 @@
+/*
+ *
+ * net-sendmmsg.c
+ *
+ * sendmmsg: Benchmark for batched datagram transmission
+ *
+ * Sends small UDP datagrams to a loopback socket, once with one
+ * sendmsg() per datagram and once with sendmmsg() in batches, and
+ * compares the packet rates.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef __NR_sendmmsg
+# if defined(__x86_64__)
+#  define __NR_sendmmsg 303
+# elif defined(__i386__)
+#  define __NR_sendmmsg 341
+# else
+#  error "__NR_sendmmsg is not defined for this architecture"
+# endif
+#endif
+
+/* struct mmsghdr, which older C libraries do not provide */
+struct bench_mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+static int nr_packets = 1000000;
+static int batch = 32;
+static int packet_size = 64;
+
+static const struct option options[] = {
+	OPT_INTEGER('n', "packets", &nr_packets,
+		    "Specify number of datagrams to send"),
+	OPT_INTEGER('b', "batch", &batch,
+		    "Specify number of datagrams per sendmmsg() call"),
+	OPT_INTEGER('s', "size", &packet_size,
+		    "Specify datagram payload size in bytes"),
+	OPT_END()
+};
+
+static const char * const bench_net_sendmmsg_usage[] = {
+	"perf bench net sendmmsg <options>",
+	NULL
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static int sys_sendmmsg(int fd, struct bench_mmsghdr *mmsg,
+			unsigned int vlen, unsigned int flags)
+{
+	return syscall(__NR_sendmmsg, fd, mmsg, vlen, flags);
+}
+
+/* Returns a UDP socket connected to a bound, never-read loopback socket */
+static int setup_sockets(int *sink)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int fd;
+
+	*sink = socket(AF_INET, SOCK_DGRAM, 0);
+	if (*sink < 0)
+		barf("socket()");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(*sink, (struct sockaddr *)&addr, sizeof(addr)))
+		barf("bind()");
+	if (getsockname(*sink, (struct sockaddr *)&addr, &len))
+		barf("getsockname()");
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		barf("socket()");
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		barf("connect()");
+	return fd;
+}
+
+static unsigned long long run_sendmsg(int fd, struct iovec *iov)
+{
+	struct timeval start, stop, diff;
+	struct msghdr msg;
+	int i;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_packets; i++) {
+		/* the sink is never read, so drops are expected */
+		if (sendmsg(fd, &msg, 0) < 0 && errno != ENOBUFS)
+			barf("sendmsg()");
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	return diff.tv_sec * 1000000ULL + diff.tv_usec;
+}
+
+static unsigned long long run_sendmmsg(int fd, struct iovec *iov)
+{
+	struct timeval start, stop, diff;
+	struct bench_mmsghdr *mmsg;
+	int i, sent, ret;
+
+	mmsg = calloc(batch, sizeof(*mmsg));
+	if (!mmsg)
+		barf("calloc()");
+	for (i = 0; i < batch; i++) {
+		mmsg[i].msg_hdr.msg_iov = iov;
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	gettimeofday(&start, NULL);
+	for (sent = 0; sent < nr_packets; sent += ret) {
+		int n = nr_packets - sent;
+
+		if (n > batch)
+			n = batch;
+		ret = sys_sendmmsg(fd, mmsg, n, 0);
+		if (ret < 0) {
+			if (errno != ENOBUFS)
+				barf("sendmmsg()");
+			/* count the dropped datagram like the sendmsg loop */
+			ret = 1;
+		}
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	free(mmsg);
+	return diff.tv_sec * 1000000ULL + diff.tv_usec;
+}
+
+static void print_result(const char *name, unsigned long long usec)
+{
+	printf(" %14s: %llu.%03llu [sec]  %14.0lf packets/sec\n", name,
+	       usec / 1000000ULL, (usec % 1000000ULL) / 1000ULL,
+	       (double)nr_packets / ((double)usec / 1000000.0));
+}
+
+int bench_net_sendmmsg(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	unsigned long long usec_single, usec_batch;
+	struct iovec iov;
+	int fd, sink;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_sendmmsg_usage, 0);
+
+	if (nr_packets < 1 || batch < 1 || packet_size < 1) {
+		fprintf(stderr, "packets, batch and size must be positive\n");
+		return 1;
+	}
+
+	iov.iov_len = packet_size;
+	iov.iov_base = calloc(1, packet_size);
+	if (!iov.iov_base)
+		barf("calloc()");
+
+	fd = setup_sockets(&sink);
+	usec_single = run_sendmsg(fd, &iov);
+	usec_batch = run_sendmmsg(fd, &iov);
+	close(fd);
+	close(sink);
+	free(iov.iov_base);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Sending %d datagrams of %d bytes, "
+		       "%d per sendmmsg() call\n\n",
+		       nr_packets, packet_size, batch);
+		print_result("sendmsg()", usec_single);
+		print_result("sendmmsg()", usec_batch);
+		printf("\n %14.2lf x speedup\n",
+		       (double)usec_single / (double)usec_batch);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu %llu.%03llu\n",
+		       usec_single / 1000000ULL,
+		       (usec_single % 1000000ULL) / 1000ULL,
+		       usec_batch / 1000000ULL,
+		       (usec_batch % 1000000ULL) / 1000ULL);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,304 @@
+/*
+ *
+ * sched-wakeup.c
+ *
+ * wakeup: Benchmark for wakeups across cpus
+ *
+ * Two processes pinned to different cpus ping-pong a token over a pair
+ * of pipes, so every operation is one remote wakeup in each direction.
+ * The run is repeated with the TTWU_QUEUE scheduler feature on and off,
+ * i.e. with the waker handing the task to the target cpu's wake list
+ * and with the waker taking the target runqueue lock itself, and the
+ * round trip time is reported together with the try_to_wake_up()
+ * counters from /proc/schedstat.  Switching the feature needs write
+ * access to <debugfs>/sched_features; without it the benchmark runs
+ * once with whatever is set.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../util/debugfs.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT	100000
+
+static int loops = LOOPS_DEFAULT;
+static const char *cpu_str;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of round trips"),
+	OPT_STRING('c', "cpus", &cpu_str, "cpu0,cpu1",
+		   "The two cpus to run on (default: first and last online)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_wakeup_usage[] = {
+	"perf bench sched wakeup <options>",
+	NULL
+};
+
+enum mode {
+	MODE_QUEUE,
+	MODE_DIRECT,
+	NR_MODES
+};
+
+static const char * const mode_features[NR_MODES] = {
+	"TTWU_QUEUE",
+	"NO_TTWU_QUEUE",
+};
+
+static const char * const mode_names[NR_MODES] = {
+	"queued",
+	"direct",
+};
+
+struct result {
+	int			valid;
+	unsigned long long	usec;
+	unsigned long long	ttwu;		/* all wakeups */
+	unsigned long long	ttwu_queued;	/* through the wake list */
+};
+
+static char features_path[PATH_MAX];
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void pin(int cpu)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		barf("sched_setaffinity()");
+}
+
+/* Sum ttwu_count and ttwu_queued over all cpus, 0 if not available */
+static int read_schedstat(unsigned long long *ttwu,
+			  unsigned long long *queued)
+{
+	char line[512];
+	unsigned long long v[13];
+	int version = 0, cpu;
+	FILE *fp;
+
+	*ttwu = *queued = 0;
+	fp = fopen("/proc/schedstat", "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "version %d", &version) == 1)
+			continue;
+		/* ttwu_queued was added as the 13th cpu field in version 16 */
+		if (version < 16)
+			break;
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu "
+			   "%llu %llu %llu", &cpu, &v[0], &v[1], &v[2], &v[3],
+			   &v[4], &v[5], &v[6], &v[7], &v[8], &v[9]) != 11)
+			continue;
+		*ttwu += v[4];
+		*queued += v[9];
+	}
+	fclose(fp);
+	return version >= 16;
+}
+
+static int set_feature(const char *feature)
+{
+	FILE *fp;
+	int ret;
+
+	if (!features_path[0])
+		return -1;
+	fp = fopen(features_path, "w");
+	if (!fp)
+		return -1;
+	ret = fputs(feature, fp) < 0 ? -1 : 0;
+	if (fclose(fp))
+		ret = -1;
+	return ret;
+}
+
+/* Returns the mode currently set, or -1 if the feature is not there */
+static int get_mode(void)
+{
+	char buf[4096];
+	size_t len;
+	FILE *fp;
+
+	fp = fopen(features_path, "r");
+	if (!fp)
+		return -1;
+	len = fread(buf, 1, sizeof(buf) - 1, fp);
+	fclose(fp);
+	buf[len] = '\0';
+
+	if (strstr(buf, "NO_TTWU_QUEUE"))
+		return MODE_DIRECT;
+	if (strstr(buf, "TTWU_QUEUE"))
+		return MODE_QUEUE;
+	return -1;
+}
+
+static void run(int cpu0, int cpu1, struct result *res)
+{
+	int pipe_1[2], pipe_2[2];
+	unsigned long long ttwu0, queued0;
+	struct timeval start, stop, diff;
+	int i, m = 0, wait_stat;
+	pid_t pid;
+
+	if (pipe(pipe_1) || pipe(pipe_2))
+		barf("pipe()");
+
+	pid = fork();
+	if (pid < 0)
+		barf("fork()");
+	if (!pid) {
+		pin(cpu1);
+		for (i = 0; i < loops; i++) {
+			if (read(pipe_1[0], &m, sizeof(m)) != sizeof(m) ||
+			    write(pipe_2[1], &m, sizeof(m)) != sizeof(m))
+				exit(1);
+		}
+		exit(0);
+	}
+
+	pin(cpu0);
+	/* one round trip first, so that both sides are settled */
+	if (write(pipe_1[1], &m, sizeof(m)) != sizeof(m) ||
+	    read(pipe_2[0], &m, sizeof(m)) != sizeof(m))
+		barf("pipe round trip");
+
+	res->valid = read_schedstat(&ttwu0, &queued0);
+	gettimeofday(&start, NULL);
+	for (i = 1; i < loops; i++) {
+		if (write(pipe_1[1], &m, sizeof(m)) != sizeof(m) ||
+		    read(pipe_2[0], &m, sizeof(m)) != sizeof(m))
+			barf("pipe round trip");
+	}
+	gettimeofday(&stop, NULL);
+	if (res->valid) {
+		read_schedstat(&res->ttwu, &res->ttwu_queued);
+		res->ttwu -= ttwu0;
+		res->ttwu_queued -= queued0;
+	}
+
+	if (waitpid(pid, &wait_stat, 0) != pid)
+		barf("waitpid()");
+	timersub(&stop, &start, &diff);
+	res->usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	close(pipe_1[0]);
+	close(pipe_1[1]);
+	close(pipe_2[0]);
+	close(pipe_2[1]);
+}
+
+int bench_sched_wakeup(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct result res[NR_MODES];
+	int cpu0, cpu1, orig_mode, mode, nr_run = 0;
+	const char *debugfs;
+	long nr_cpus;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_wakeup_usage, 0);
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu0 = 0;
+	cpu1 = nr_cpus - 1;
+	if (cpu_str && sscanf(cpu_str, "%d,%d", &cpu0, &cpu1) != 2) {
+		fprintf(stderr, "Invalid cpus: %s\n", cpu_str);
+		return 1;
+	}
+	if (cpu0 == cpu1 || cpu0 < 0 || cpu1 < 0) {
+		fprintf(stderr, "Need two different cpus\n");
+		return 1;
+	}
+	if (loops < 2) {
+		fprintf(stderr, "loop must be at least 2\n");
+		return 1;
+	}
+
+	debugfs = debugfs_mount(NULL);
+	if (debugfs)
+		snprintf(features_path, sizeof(features_path),
+			 "%s/sched_features", debugfs);
+	orig_mode = features_path[0] ? get_mode() : -1;
+
+	memset(res, 0, sizeof(res));
+	for (mode = 0; mode < NR_MODES; mode++) {
+		if (set_feature(mode_features[mode]))
+			continue;
+		run(cpu0, cpu1, &res[mode]);
+		nr_run++;
+	}
+	if (orig_mode >= 0)
+		set_feature(mode_features[orig_mode]);
+
+	if (!nr_run) {
+		fprintf(stderr, "Cannot switch TTWU_QUEUE, running with the "
+			"current setting only\n");
+		mode = orig_mode >= 0 ? orig_mode : MODE_DIRECT;
+		run(cpu0, cpu1, &res[mode]);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d round trips between cpu %d and cpu %d\n\n",
+		       loops, cpu0, cpu1);
+		printf(" %8s %14s %16s %14s\n", "wakeup", "usecs/op",
+		       "wakeups/op", "queued [%]");
+		for (mode = 0; mode < NR_MODES; mode++) {
+			struct result *r = &res[mode];
+
+			if (!r->usec)
+				continue;
+			printf(" %8s %14.3lf", mode_names[mode],
+			       (double)r->usec / (loops - 1));
+			if (r->valid && r->ttwu)
+				printf(" %16.2lf %14.1lf\n",
+				       (double)r->ttwu / (loops - 1),
+				       100.0 * r->ttwu_queued / r->ttwu);
+			else
+				printf(" %16s %14s\n", "n/a", "n/a");
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		for (mode = 0; mode < NR_MODES; mode++)
+			printf("%.3lf%s", (double)res[mode].usec / (loops - 1),
+			       mode == NR_MODES - 1 ? "\n" : " ");
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,7 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  fs    ... filesystem and VFS scalability
  *
  */
 
@@ -42,6 +43,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "wakeup",
+	  "Remote wakeups, queued vs. direct (TTWU_QUEUE)",
+	  bench_sched_wakeup    },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -52,6 +56,55 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "reclaim",
+	  "Page reclaim with a hot anon set and a cold file stream",
+	  bench_mem_reclaim },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "lookup",
+	  "Parallel pathname lookup of a cached path",
+	  bench_fs_lookup },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "sendmmsg",
+	  "Datagram transmit rate, sendmsg() loop vs. sendmmsg()",
+	  bench_net_sendmmsg },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wakeup",
+	  "Event dispatch to a thread pool, shared vs. exclusive wakeups",
+	  bench_epoll_wakeup },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Futex hash bucket contention of unrelated futexes",
+	  bench_futex_hash },
+	{ "wake",
+	  "Waking the waiters of one futex one by one",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Requeueing the waiters of one futex to another",
+	  bench_futex_requeue },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +124,18 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "fs",
+	  "filesystem and VFS scalability",
+	  fs_suites },
+	{ "net",
+	  "networking system calls",
+	  net_suites },
+	{ "epoll",
+	  "epoll event dispatch",
+	  epoll_suites },
+	{ "futex",
+	  "futex wait, wake and requeue",
+	  futex_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },